@@ -0,0 +1,217 @@
+#include "atlas.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "glstate.h"
+#include "math2d.h"
+#include "texture.h"
+#include "util.h"
+
+/*
+ * Rectangle packing.
+ */
+void init_packer(rect_packer* packer, int width, int height) {
+	packer->width = width;
+	packer->height = height;
+	packer->skyline.clear();
+	skyline_node floor = { 0, 0, width };
+	packer->skyline.push_back(floor);
+}
+
+// Height a w-wide rectangle would sit at if placed at skyline[i].x,
+// or -1 if it runs off the right edge.
+static int skyline_fit(const rect_packer* packer, int i, int w) {
+	int x = packer->skyline[i].x;
+	if (x + w > packer->width) { return -1; }
+	int y = 0;
+	int remaining = w;
+	while (remaining > 0) {
+		y = std::max(y, packer->skyline[i].y);
+		remaining -= packer->skyline[i].w;
+		i++;
+	}
+	return y;
+}
+
+bool pack_rect(rect_packer* packer, int w, int h, int* x, int* y) {
+	int best = -1;
+	int best_y = packer->height;
+	for (unsigned int i=0; i<packer->skyline.size(); i++) {
+		int fit_y = skyline_fit(packer, i, w);
+		if (fit_y >= 0 && fit_y + h <= packer->height && fit_y < best_y) {
+			best = i;
+			best_y = fit_y;
+		}
+	}
+	if (best < 0) { return false; }
+
+	*x = packer->skyline[best].x;
+	*y = best_y;
+
+	// Raise the skyline under the new rectangle.
+	skyline_node top = { *x, best_y + h, w };
+	std::vector<skyline_node>& sky = packer->skyline;
+	sky.insert(sky.begin() + best, top);
+	for (unsigned int i=best+1; i<sky.size(); ) {
+		int overlap = (top.x + top.w) - sky[i].x;
+		if (overlap <= 0) { break; }
+		if (overlap < sky[i].w) {
+			sky[i].x += overlap;
+			sky[i].w -= overlap;
+			break;
+		}
+		sky.erase(sky.begin() + i);
+	}
+	// Merge neighbours at the same height.
+	for (unsigned int i=0; i+1<sky.size(); ) {
+		if (sky[i].y == sky[i+1].y) {
+			sky[i].w += sky[i+1].w;
+			sky.erase(sky.begin() + i + 1);
+		}
+		else { i++; }
+	}
+	return true;
+}
+
+/*
+ * Atlas building.
+ */
+struct atlas_source {
+	int index;
+	int x, y;
+	unsigned char* data;
+};
+
+static bool taller_first(const atlas_source& a, const atlas_source& b) {
+	return a.y > b.y;
+}
+
+// Copy an image into a page with ATLAS_PADDING of clamped edge texels.
+static void blit_padded(unsigned char* page, int page_w,
+						const unsigned char* img, int w, int h, int dst_x, int dst_y) {
+	int pw = w + ATLAS_PADDING*2;
+	int ph = h + ATLAS_PADDING*2;
+	for (int j=0; j<ph; j++) {
+		int sy = std::min(std::max(j - ATLAS_PADDING, 0), h-1);
+		unsigned char* dst = page + ((dst_y + j) * page_w + dst_x) * 4;
+		for (int i=0; i<pw; i++) {
+			int sx = std::min(std::max(i - ATLAS_PADDING, 0), w-1);
+			memcpy(dst + i*4, img + (sy * w + sx) * 4, 4);
+		}
+	}
+}
+
+int build_texture_atlas(const char** filenames, int count, int size,
+						GLenum target, texture_atlas* atlas) {
+	atlas->tex = 0;
+	atlas->target = target;
+	atlas->width = atlas->height = size;
+	atlas->layers = 0;
+	atlas->entries.assign(count, atlas_entry());
+
+	std::vector<atlas_source> sources;
+	int failed = 0;
+	for (int i=0; i<count; i++) {
+		atlas_source src;
+		src.index = i;
+		src.data = load_image(filenames[i], &src.x, &src.y, 4);
+		if (!src.data) {
+			gl_log_error("ERROR: Could not load image: %s\n", filenames[i]);
+			failed++;
+			continue;
+		}
+		flip_tex_V(src.data, src.x, src.y, 4);
+		sources.push_back(src);
+	}
+	// Tallest first packs noticeably tighter on a skyline.
+	std::stable_sort(sources.begin(), sources.end(), taller_first);
+
+	std::vector<rect_packer> pages;
+	for (unsigned int s=0; s<sources.size(); s++) {
+		const atlas_source& src = sources[s];
+		int pw = src.x + ATLAS_PADDING*2;
+		int ph = src.y + ATLAS_PADDING*2;
+		int x = 0, y = 0;
+		int layer = -1;
+		for (unsigned int p=0; p<pages.size(); p++) {
+			if (pack_rect(&pages[p], pw, ph, &x, &y)) {
+				layer = p;
+				break;
+			}
+		}
+		if (layer < 0 && (pages.empty() || target == GL_TEXTURE_2D_ARRAY)) {
+			rect_packer page;
+			init_packer(&page, size, size);
+			if (pack_rect(&page, pw, ph, &x, &y)) {
+				pages.push_back(page);
+				layer = pages.size() - 1;
+			}
+		}
+		if (layer < 0) {
+			gl_log_error("ERROR: %s does not fit in a %ix%i atlas\n",
+						 filenames[src.index], size, size);
+			failed++;
+			continue;
+		}
+
+		atlas_entry* e = &atlas->entries[src.index];
+		e->layer = layer;
+		e->x = x + ATLAS_PADDING;
+		e->y = y + ATLAS_PADDING;
+		e->w = src.x;
+		e->h = src.y;
+		e->uv_offset[0] = (float)e->x / size;
+		e->uv_offset[1] = (float)e->y / size;
+		e->uv_scale[0] = (float)e->w / size;
+		e->uv_scale[1] = (float)e->h / size;
+	}
+	atlas->layers = pages.size();
+	if (atlas->layers == 0) {
+		// Nothing loaded or nothing fit; a zero-layer texture is invalid.
+		gl_log_error("ERROR: No images to pack into a %ix%i atlas\n", size, size);
+		for (unsigned int s=0; s<sources.size(); s++) {
+			free_image(sources[s].data);
+		}
+		return 1;
+	}
+
+	// Assemble and upload each page.
+	glGenTextures(1, &atlas->tex);
+	gl_bind_texture(target, atlas->tex);
+	if (target == GL_TEXTURE_2D_ARRAY) {
+		glTexStorage3D(target, ATLAS_MAX_LEVEL + 1, GL_SRGB8_ALPHA8, size, size, atlas->layers);
+	}
+	else {
+		glTexStorage2D(target, ATLAS_MAX_LEVEL + 1, GL_SRGB8_ALPHA8, size, size);
+	}
+	std::vector<unsigned char> page((size_t)size * size * 4);
+	for (int l=0; l<atlas->layers; l++) {
+		std::fill(page.begin(), page.end(), 0);
+		for (unsigned int s=0; s<sources.size(); s++) {
+			const atlas_entry* e = &atlas->entries[sources[s].index];
+			if (e->layer != l || e->w == 0) { continue; }
+			blit_padded(&page[0], size, sources[s].data, e->w, e->h,
+						e->x - ATLAS_PADDING, e->y - ATLAS_PADDING);
+		}
+		if (target == GL_TEXTURE_2D_ARRAY) {
+			glTexSubImage3D(target, 0, 0, 0, l, size, size, 1,
+							GL_RGBA, GL_UNSIGNED_BYTE, &page[0]);
+		}
+		else {
+			glTexSubImage2D(target, 0, 0, 0, size, size,
+							GL_RGBA, GL_UNSIGNED_BYTE, &page[0]);
+		}
+	}
+	glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, ATLAS_MAX_LEVEL);
+	glGenerateMipmap(target);
+
+	for (unsigned int s=0; s<sources.size(); s++) {
+		free_image(sources[s].data);
+	}
+
+	gl_log("Packed %i textures into %i %ix%i atlas page(s)\n",
+		   count - failed, atlas->layers, size, size);
+	return failed ? 1 : 0;
+}
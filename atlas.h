@@ -0,0 +1,56 @@
+#ifndef KESHI_ATLAS
+#define KESHI_ATLAS
+
+#include <GL/glew.h>
+
+#include <vector>
+
+// Gutter around each packed image, filled with its clamped edge texels.
+// Mips below log2(ATLAS_PADDING) would bleed between neighbours, so the
+// atlas texture's max level is capped there.
+#define ATLAS_PADDING 4
+#define ATLAS_MAX_LEVEL 2
+
+/*
+ * Skyline bottom-left rectangle packer.
+ * The skyline is a list of horizontal segments covering the full width;
+ * each new rectangle goes at the lowest spot it fits, leftmost on ties.
+ */
+struct skyline_node {
+	int x, y, w;
+};
+
+struct rect_packer {
+	int width, height;
+	std::vector<skyline_node> skyline;
+};
+
+void init_packer(rect_packer* packer, int width, int height);
+bool pack_rect(rect_packer* packer, int w, int h, int* x, int* y);
+
+/*
+ * Where one source image ended up. UVs in [0, 1] for the original image
+ * map to uv_offset + uv * uv_scale in the atlas, on layer 'layer'.
+ * Meshes keep their own UVs; the shader applies this (see materials.h).
+ */
+struct atlas_entry {
+	int layer;
+	int x, y, w, h;
+	float uv_offset[2];
+	float uv_scale[2];
+};
+
+// target is GL_TEXTURE_2D (everything must fit on one page) or
+// GL_TEXTURE_2D_ARRAY (one layer per page). Returns nonzero if any
+// image failed; if none made it, atlas->tex is left 0.
+struct texture_atlas {
+	GLuint tex;
+	GLenum target;
+	int width, height, layers;
+	std::vector<atlas_entry> entries;
+};
+
+int build_texture_atlas(const char** filenames, int count, int size,
+						GLenum target, texture_atlas* atlas);
+
+#endif
@@ -0,0 +1,142 @@
+#include "batch.h"
+
+#include <stddef.h>
+
+#include "glstate.h"
+#include "instances.h"
+#include "util.h"
+
+static_assert(sizeof(draw_arrays_command) == 16, "draw_arrays_command must match DrawArraysIndirectCommand");
+
+static vertex_format static_format;
+static bool static_format_built = false;
+static GLuint identity_instance = 0;
+
+vertex_format* static_vertex_format() {
+	if (static_format_built) { return &static_format; }
+	init_vertex_format(&static_format);
+	add_vertex_attrib(&static_format, 0, 3, GL_FLOAT, STATIC_VERTEX_BINDING, offsetof(static_vertex, pos));
+	add_vertex_attrib(&static_format, 1, 3, GL_FLOAT, STATIC_VERTEX_BINDING, offsetof(static_vertex, normal));
+	add_vertex_attrib(&static_format, 2, 2, GL_FLOAT, STATIC_VERTEX_BINDING, offsetof(static_vertex, uv));
+	for (int col=0; col<4; col++) {
+		add_vertex_attrib(&static_format, INSTANCE_MATRIX_LOCATION + col, 4, GL_FLOAT,
+						  STATIC_INSTANCE_BINDING, sizeof(float) * 4 * col);
+	}
+	set_vertex_binding_divisor(&static_format, STATIC_INSTANCE_BINDING, 1);
+	build_vertex_format(&static_format);
+	m4 identity = id4();
+	identity_instance = create_buffer(sizeof(m4), &identity, 0);
+	static_format_built = true;
+	return &static_format;
+}
+
+void destroy_static_vertex_format() {
+	if (!static_format_built) { return; }
+	destroy_vertex_format(&static_format);
+	delete_buffer(&identity_instance);
+	static_format_built = false;
+}
+
+// The unbatched way sets up a VAO per object, with the model matrix
+// left to the generic attribute (set_default_model_matrix).
+static void set_vertex_format() {
+	GLsizei stride = sizeof(static_vertex);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(static_vertex, pos));
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(static_vertex, normal));
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(static_vertex, uv));
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+}
+
+void init_static_batch(static_batch* batch) {
+	batch->vertices.clear();
+	batch->commands.clear();
+	batch->firsts.clear();
+	batch->counts.clear();
+	batch->mode = BATCH_MULTI_DRAW_INDIRECT;
+	batch->vbo = batch->indirect_buffer = 0;
+}
+
+int add_static_mesh(static_batch* batch, const GLfloat* points, const GLfloat* normals,
+					const GLfloat* texcoords, int num_vertices) {
+	draw_arrays_command cmd = { (GLuint)num_vertices, 1, (GLuint)batch->vertices.size(), 0 };
+	for (int i=0; i<num_vertices; i++) {
+		static_vertex v = { { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f } };
+		for (int c=0; c<3; c++) {
+			if (points)  { v.pos[c] = points[i*3 + c]; }
+			if (normals) { v.normal[c] = normals[i*3 + c]; }
+		}
+		if (texcoords) {
+			v.uv[0] = texcoords[i*2];
+			v.uv[1] = texcoords[i*2 + 1];
+		}
+		batch->vertices.push_back(v);
+	}
+	batch->commands.push_back(cmd);
+	batch->firsts.push_back(cmd.first);
+	batch->counts.push_back(cmd.count);
+	return batch->commands.size() - 1;
+}
+
+void build_static_batch(static_batch* batch) {
+	// Storage is immutable; a rebuild starts over.
+	if (batch->vbo) { destroy_static_batch(batch); }
+	batch->vbo = create_buffer(sizeof(static_vertex) * batch->vertices.size(),
+							   batch->vertices.empty() ? NULL : &batch->vertices[0], 0);
+	batch->indirect_buffer = create_buffer(sizeof(draw_arrays_command) * batch->commands.size(),
+										   batch->commands.empty() ? NULL : &batch->commands[0], 0);
+
+	if (!gl_caps.multi_draw_indirect) { batch->mode = BATCH_MULTI_DRAW; }
+	gl_log("Static batch: %i objects, %i vertices, %s\n", (int)batch->commands.size(),
+		   (int)batch->vertices.size(),
+		   (batch->mode == BATCH_MULTI_DRAW_INDIRECT) ? "indirect" : "multi draw");
+}
+
+int draw_static_batch(const static_batch* batch, int first, int count) {
+	if (count <= 0) { return 0; }
+	vertex_format* format = static_vertex_format();
+	gl_bind_vao(format->vao);
+	bind_vertex_buffer(format, STATIC_VERTEX_BINDING, batch->vbo, 0, sizeof(static_vertex));
+	bind_vertex_buffer(format, STATIC_INSTANCE_BINDING, identity_instance, 0, sizeof(m4));
+	if (batch->mode == BATCH_MULTI_DRAW_INDIRECT) {
+		gl_bind_buffer(GL_DRAW_INDIRECT_BUFFER, batch->indirect_buffer);
+		glMultiDrawArraysIndirect(GL_TRIANGLES, (void*)(sizeof(draw_arrays_command) * first), count, 0);
+	}
+	else {
+		glMultiDrawArrays(GL_TRIANGLES, &batch->firsts[first], &batch->counts[first], count);
+	}
+	return 1;
+}
+
+void destroy_static_batch(static_batch* batch) {
+	if (static_format_built) { detach_vertex_buffer(&static_format, batch->vbo); }
+	delete_buffer(&batch->vbo);
+	delete_buffer(&batch->indirect_buffer);
+}
+
+void build_separate_vaos(const static_batch* batch, std::vector<GLuint>* vaos, std::vector<GLuint>* vbos) {
+	int n = batch->commands.size();
+	vaos->assign(n, 0);
+	vbos->assign(n, 0);
+	if (!n) { return; }
+	glGenVertexArrays(n, &(*vaos)[0]);
+	glGenBuffers(n, &(*vbos)[0]);
+	for (int i=0; i<n; i++) {
+		const draw_arrays_command& cmd = batch->commands[i];
+		gl_bind_vao((*vaos)[i]);
+		gl_bind_buffer(GL_ARRAY_BUFFER, (*vbos)[i]);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(static_vertex) * cmd.count,
+					 &batch->vertices[cmd.first], GL_STATIC_DRAW);
+		set_vertex_format();
+	}
+	gl_bind_vao(0);
+}
+
+int draw_separate_vaos(const static_batch* batch, const std::vector<GLuint>& vaos, int first, int count) {
+	for (int i=first; i<first+count; i++) {
+		gl_bind_vao(vaos[i]);
+		glDrawArrays(GL_TRIANGLES, 0, batch->commands[i].count);
+	}
+	return count;
+}
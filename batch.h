@@ -0,0 +1,74 @@
+#ifndef KESHI_BATCH
+#define KESHI_BATCH
+
+#include <GL/glew.h>
+
+#include <vector>
+
+#include "glresource.h"
+
+#define BATCH_MULTI_DRAW 0
+#define BATCH_MULTI_DRAW_INDIRECT 1
+
+// Interleaved; position, normal and texcoord at attribute locations 0, 1, 2.
+struct static_vertex {
+	GLfloat pos[3];
+	GLfloat normal[3];
+	GLfloat uv[2];
+};
+
+// Laid out as GL wants it in the indirect buffer.
+struct draw_arrays_command {
+	GLuint count;
+	GLuint instance_count;
+	GLuint first;
+	GLuint base_instance;
+};
+
+// Binding points in the static_vertex format: vertices, and model
+// matrices stepped per instance (see instances.h).
+#define STATIC_VERTEX_BINDING 0
+#define STATIC_INSTANCE_BINDING 1
+
+/*
+ * Static geometry sharing one vertex format, packed into one buffer
+ * and drawn through the format's shared VAO. Each object added is a
+ * command in a list built once, so drawing any run of consecutive
+ * objects is a single glMultiDrawArraysIndirect (or glMultiDrawArrays)
+ * with no rebinding.
+ * Add objects that are drawn together (same program and state) next
+ * to each other.
+ */
+struct static_batch {
+	std::vector<static_vertex> vertices;
+	std::vector<draw_arrays_command> commands;
+	// The same list, split up for glMultiDrawArrays.
+	std::vector<GLint> firsts;
+	std::vector<GLsizei> counts;
+	int mode;
+	GLuint vbo;
+	GLuint indirect_buffer;
+};
+
+void init_static_batch(static_batch* batch);
+// Returns the object's index. Any of the attribute arrays can be NULL.
+int add_static_mesh(static_batch* batch, const GLfloat* points, const GLfloat* normals,
+					const GLfloat* texcoords, int num_vertices);
+// Uploads everything added so far.
+void build_static_batch(static_batch* batch);
+// Objects [first, first + count) in one call. Returns draw calls made.
+int draw_static_batch(const static_batch* batch, int first, int count);
+void destroy_static_batch(static_batch* batch);
+
+// The one VAO every static_vertex mesh draws from, made on first use.
+// Batches draw with a single identity model matrix at the instance binding.
+vertex_format* static_vertex_format();
+void destroy_static_vertex_format();
+
+/*
+ * The unbatched way, one VAO and buffer per object, to benchmark against.
+ */
+void build_separate_vaos(const static_batch* batch, std::vector<GLuint>* vaos, std::vector<GLuint>* vbos);
+int draw_separate_vaos(const static_batch* batch, const std::vector<GLuint>& vaos, int first, int count);
+
+#endif
@@ -0,0 +1,242 @@
+/*
+ * CPU-side micro benchmarks.
+ * Usage: bench decode <image> [<image> ...]
+ *        bench log
+ *        bench sort
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "logger.h"
+#include "qoi.h"
+#include "renderqueue.h"
+#include "stb_image.h"
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double seconds_since(bench_clock::time_point start) {
+	return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+static bool read_file(const char* filename, std::vector<unsigned char>* out) {
+	FILE* file = fopen(filename, "rb");
+	if (!file) { return false; }
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	out->resize(size > 0 ? size : 0);
+	bool ok = size > 0 && fread(&(*out)[0], 1, size, file) == (size_t)size;
+	fclose(file);
+	return ok;
+}
+
+/*
+ * Decode throughput, in MB/s of RGBA8 output, for stb_image on the
+ * original file versus QOI on the same pixels re-encoded in memory.
+ */
+static int bench_decode(int count, char** filenames) {
+	const double min_time = 0.5;
+	printf("%-40s %10s %10s %10s %10s\n", "image", "png KB", "qoi KB", "png MB/s", "qoi MB/s");
+
+	for (int i=0; i<count; i++) {
+		std::vector<unsigned char> png;
+		if (!read_file(filenames[i], &png)) {
+			fprintf(stderr, "Error: Could not read %s\n", filenames[i]);
+			return 1;
+		}
+
+		int x, y, n;
+		unsigned char* pixels = stbi_load_from_memory(&png[0], png.size(), &x, &y, &n, 4);
+		if (!pixels) {
+			fprintf(stderr, "Error: Could not decode %s\n", filenames[i]);
+			return 1;
+		}
+		int qoi_len = 0;
+		unsigned char* qoi = qoi_encode(pixels, x, y, 4, &qoi_len);
+		double mb = (double)x * y * 4 / (1024.0 * 1024.0);
+
+		// Check the round trip while we're here.
+		int qx, qy;
+		unsigned char* check = qoi_decode(qoi, qoi_len, &qx, &qy, NULL, 4);
+		if (!check || qx != x || qy != y || memcmp(check, pixels, (size_t)x * y * 4) != 0) {
+			fprintf(stderr, "Error: QOI round trip mismatch for %s\n", filenames[i]);
+			return 1;
+		}
+		free(check);
+
+		int runs = 0;
+		bench_clock::time_point start = bench_clock::now();
+		do {
+			free(stbi_load_from_memory(&png[0], png.size(), &x, &y, &n, 4));
+			runs++;
+		} while (seconds_since(start) < min_time);
+		double png_rate = mb * runs / seconds_since(start);
+
+		runs = 0;
+		start = bench_clock::now();
+		do {
+			free(qoi_decode(qoi, qoi_len, &qx, &qy, NULL, 4));
+			runs++;
+		} while (seconds_since(start) < min_time);
+		double qoi_rate = mb * runs / seconds_since(start);
+
+		printf("%-40s %10.1f %10.1f %10.1f %10.1f\n", filenames[i],
+			   png.size() / 1024.0, qoi_len / 1024.0, png_rate, qoi_rate);
+		free(qoi);
+		free(pixels);
+	}
+	return 0;
+}
+
+/*
+ * Cost of a gl_log() call on the calling thread, formatting there
+ * (LOG_MODE_TEXT) versus queueing a binary record (LOG_MODE_DEFERRED),
+ * then of a log call that's filtered out.
+ * Bursts are kept under the ring size and flushed between, untimed, so
+ * this measures the producer side and not the disk.
+ */
+static int bench_log() {
+	if (restart_gl_log() != 0) { return 1; }
+	const int burst = LOG_RING_SLOTS / 4;
+	const int bursts = 500;
+	const char* names[] = { "text", "deferred" };
+	int modes[] = { LOG_MODE_TEXT, LOG_MODE_DEFERRED };
+	for (int m=0; m<2; m++) {
+		gl_log_mode = modes[m];
+		double total = 0.0;
+		for (int b=0; b<bursts; b++) {
+			flush_gl_log();
+			bench_clock::time_point start = bench_clock::now();
+			for (int i=0; i<burst; i++) {
+				gl_log("frame %i took %.3fms on %s\n", i, 16.6, "main");
+			}
+			total += seconds_since(start);
+		}
+		printf("%-10s %8.1f ns/call\n", names[m], total * 1e9 / ((double)burst * bursts));
+	}
+	log_stats stats = gl_log_stats();
+	printf("%lu messages, %lu dropped\n", stats.messages, stats.dropped);
+
+	// A filtered-out call in a tight loop should cost next to nothing.
+	// The same loop with and without a log_trace() nobody listens to.
+	set_log_level(LOG_GENERAL, LOG_LEVEL_INFO);
+	const int iterations = 200000000;
+	uint64_t x = 88172645463325252ULL;
+	bench_clock::time_point start = bench_clock::now();
+	for (int i=0; i<iterations; i++) {
+		x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+	}
+	double bare = seconds_since(start);
+	uint64_t y = 88172645463325252ULL;
+	start = bench_clock::now();
+	for (int i=0; i<iterations; i++) {
+		y ^= y << 13; y ^= y >> 7; y ^= y << 17;
+		log_trace(LOG_GENERAL, "step %i: %llu\n", i, (unsigned long long)y);
+	}
+	double filtered = seconds_since(start);
+	printf("%-10s %8.3f ns/iteration\n", "no log", bare * 1e9 / iterations);
+	printf("%-10s %8.3f ns/iteration (%s)\n", "disabled", filtered * 1e9 / iterations,
+		   (LOG_MIN_LEVEL > LOG_LEVEL_TRACE) ? "compiled out" : "runtime filter");
+	if (x != y) { printf("mismatch\n"); }
+	return 0;
+}
+
+static bool key_less(const render_item& a, const render_item& b) {
+	return a.key < b.key;
+}
+
+/*
+ * Render queue sort time per frame, against std::stable_sort on the same
+ * items, after checking the keys unpack to what went in. Keys look like a big scene's: a handful of programs, a few
+ * hundred materials and VAOs, depth all over the place. The frame budget
+ * for sorting is a millisecond at 100k items.
+ */
+static int bench_sort() {
+	const int sizes[] = { 1000, 10000, 100000, 1000000 };
+	const double min_time = 0.5;
+	printf("%10s %12s %12s\n", "items", "radix ms", "std ms");
+	for (unsigned int s=0; s<sizeof(sizes) / sizeof(sizes[0]); s++) {
+		int n = sizes[s];
+		std::vector<render_item> frame(n);
+		uint64_t x = 88172645463325252ULL;
+		for (int i=0; i<n; i++) {
+			x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+			unsigned int program = 1 + (x & 7);
+			unsigned int material = (x >> 8) % 500;
+			unsigned int vao = 1 + (x >> 20) % 300;
+			float depth = (float)((x >> 40) & 0xFFFFFF) / 0xFFFFFF;
+			frame[i].key = render_key(RENDER_PASS_OPAQUE, program, material, vao, depth);
+			frame[i].draw = i;
+			// Every field has to come back out as it went in.
+			if (render_key_pass(frame[i].key) != RENDER_PASS_OPAQUE ||
+				render_key_program(frame[i].key) != program ||
+				render_key_material(frame[i].key) != material ||
+				render_key_vao(frame[i].key) != vao) {
+				fprintf(stderr, "Error: render key %016llx doesn't round-trip\n",
+						(unsigned long long)frame[i].key);
+				return 1;
+			}
+		}
+
+		render_queue queue;
+		int runs = 0;
+		double total = 0.0;
+		do {
+			clear_render_queue(&queue);
+			for (int i=0; i<n; i++) {
+				submit_render_item(&queue, frame[i].key, frame[i].draw);
+			}
+			bench_clock::time_point start = bench_clock::now();
+			sort_render_queue(&queue);
+			total += seconds_since(start);
+			runs++;
+		} while (total < min_time);
+		double radix_ms = total * 1000.0 / runs;
+
+		std::vector<render_item> check = frame;
+		std::stable_sort(check.begin(), check.end(), key_less);
+		for (int i=0; i<n; i++) {
+			if (queue.items[i].key != check[i].key || queue.items[i].draw != check[i].draw) {
+				fprintf(stderr, "Error: radix sort differs from std::stable_sort at %i\n", i);
+				return 1;
+			}
+		}
+
+		runs = 0;
+		total = 0.0;
+		do {
+			check = frame;
+			bench_clock::time_point start = bench_clock::now();
+			std::stable_sort(check.begin(), check.end(), key_less);
+			total += seconds_since(start);
+			runs++;
+		} while (total < min_time);
+		double std_ms = total * 1000.0 / runs;
+
+		printf("%10i %12.3f %12.3f\n", n, radix_ms, std_ms);
+	}
+	return 0;
+}
+
+int main(int argc, char** args) {
+	if (argc > 2 && strcmp(args[1], "decode") == 0) {
+		return bench_decode(argc - 2, args + 2);
+	}
+	if (argc > 1 && strcmp(args[1], "log") == 0) {
+		return bench_log();
+	}
+	if (argc > 1 && strcmp(args[1], "sort") == 0) {
+		return bench_sort();
+	}
+
+	fprintf(stderr, "Usage: %s decode <image> [<image> ...]\n", args[0]);
+	fprintf(stderr, "       %s log\n", args[0]);
+	fprintf(stderr, "       %s sort\n", args[0]);
+	return 1;
+}
@@ -0,0 +1,333 @@
+#include "commands.h"
+
+#include <string.h>
+
+#include "batch.h"
+#include "glresource.h"
+#include "glstate.h"
+#include "gputimer.h"
+#include "uniformring.h"
+#include "util.h"
+
+// Sizes are in 8-byte words, so every command stays aligned.
+struct cmd_header {
+	uint32_t type;
+	uint32_t words;
+};
+
+struct cmd_name {
+	cmd_header header;
+	GLuint name;
+};
+
+struct cmd_buffer_base {
+	cmd_header header;
+	GLenum target;
+	GLuint index;
+	GLuint buffer;
+};
+
+struct cmd_vertex_buffer {
+	cmd_header header;
+	vertex_format* format;
+	GLuint binding;
+	GLuint buffer;
+	GLintptr offset;
+	GLsizei stride;
+};
+
+struct cmd_texture {
+	cmd_header header;
+	GLenum unit;
+	GLenum target;
+	GLuint texture;
+};
+
+struct cmd_uniform_ints {
+	cmd_header header;
+	GLint location;
+	GLint count;
+	GLint v[2];
+};
+
+// Followed by 'size' bytes of data.
+struct cmd_uniform_data {
+	cmd_header header;
+	GLenum target;
+	GLuint binding;
+	GLint size;
+};
+
+struct cmd_draw {
+	cmd_header header;
+	GLenum mode;
+	GLint first;
+	GLsizei count;
+	GLsizei instances;
+	GLuint base_instance;
+};
+
+struct cmd_batch {
+	cmd_header header;
+	const static_batch* batch;
+	GLint first;
+	GLint count;
+};
+
+struct cmd_timer {
+	cmd_header header;
+	gpu_timer* timer;
+};
+
+static int words_for(int bytes) {
+	return (bytes + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+}
+
+// Room for a command and 'extra' bytes after it.
+template <typename T>
+static T* push(command_list* list, uint32_t type, int extra = 0) {
+	int words = words_for(sizeof(T) + extra);
+	size_t at = list->data.size();
+	list->data.resize(at + words, 0);
+	T* cmd = (T*)&list->data[at];
+	cmd->header.type = type;
+	cmd->header.words = words;
+	list->commands++;
+	return cmd;
+}
+
+void reset_command_list(command_list* list) {
+	list->data.clear();
+	list->commands = 0;
+}
+
+void cmd_use_program(command_list* list, GLuint program) {
+	push<cmd_name>(list, CMD_USE_PROGRAM)->name = program;
+}
+
+void cmd_bind_vao(command_list* list, GLuint vao) {
+	push<cmd_name>(list, CMD_BIND_VAO)->name = vao;
+}
+
+void cmd_bind_buffer_base(command_list* list, GLenum target, GLuint index, GLuint buffer) {
+	cmd_buffer_base* cmd = push<cmd_buffer_base>(list, CMD_BIND_BUFFER_BASE);
+	cmd->target = target;
+	cmd->index = index;
+	cmd->buffer = buffer;
+}
+
+void cmd_bind_vertex_buffer(command_list* list, vertex_format* format, GLuint binding, GLuint buffer,
+							GLintptr offset, GLsizei stride) {
+	cmd_vertex_buffer* cmd = push<cmd_vertex_buffer>(list, CMD_BIND_VERTEX_BUFFER);
+	cmd->format = format;
+	cmd->binding = binding;
+	cmd->buffer = buffer;
+	cmd->offset = offset;
+	cmd->stride = stride;
+}
+
+void cmd_bind_texture(command_list* list, GLenum unit, GLenum target, GLuint texture) {
+	cmd_texture* cmd = push<cmd_texture>(list, CMD_BIND_TEXTURE);
+	cmd->unit = unit;
+	cmd->target = target;
+	cmd->texture = texture;
+}
+
+void cmd_uniform_1i(command_list* list, GLint location, GLint x) {
+	cmd_uniform_ints* cmd = push<cmd_uniform_ints>(list, CMD_UNIFORM_INTS);
+	cmd->location = location;
+	cmd->count = 1;
+	cmd->v[0] = x;
+}
+
+void cmd_uniform_2i(command_list* list, GLint location, GLint x, GLint y) {
+	cmd_uniform_ints* cmd = push<cmd_uniform_ints>(list, CMD_UNIFORM_INTS);
+	cmd->location = location;
+	cmd->count = 2;
+	cmd->v[0] = x;
+	cmd->v[1] = y;
+}
+
+void* cmd_uniforms(command_list* list, GLenum target, GLuint binding, int size) {
+	cmd_uniform_data* cmd = push<cmd_uniform_data>(list, CMD_UNIFORMS, size);
+	cmd->target = target;
+	cmd->binding = binding;
+	cmd->size = size;
+	return cmd + 1;
+}
+
+void cmd_draw_arrays(command_list* list, GLenum mode, GLint first, GLsizei count,
+					 GLsizei instances, GLuint base_instance) {
+	cmd_draw* cmd = push<cmd_draw>(list, CMD_DRAW_ARRAYS);
+	cmd->mode = mode;
+	cmd->first = first;
+	cmd->count = count;
+	cmd->instances = instances;
+	cmd->base_instance = base_instance;
+}
+
+void cmd_draw_batch(command_list* list, const static_batch* batch, int first, int count) {
+	cmd_batch* cmd = push<cmd_batch>(list, CMD_DRAW_BATCH);
+	cmd->batch = batch;
+	cmd->first = first;
+	cmd->count = count;
+}
+
+void cmd_begin_gpu_timer(command_list* list, gpu_timer* timer) {
+	push<cmd_timer>(list, CMD_BEGIN_TIMER)->timer = timer;
+}
+
+void cmd_end_gpu_timer(command_list* list, gpu_timer* timer) {
+	push<cmd_timer>(list, CMD_END_TIMER)->timer = timer;
+}
+
+int replay_command_list(const command_list* list, uniform_ring* ring) {
+	int draws = 0;
+	size_t at = 0;
+	while (at < list->data.size()) {
+		const cmd_header* header = (const cmd_header*)&list->data[at];
+		at += header->words;
+		switch (header->type) {
+		case CMD_USE_PROGRAM:
+			gl_use_program(((const cmd_name*)header)->name);
+			break;
+		case CMD_BIND_VAO:
+			gl_bind_vao(((const cmd_name*)header)->name);
+			break;
+		case CMD_BIND_BUFFER_BASE: {
+			const cmd_buffer_base* cmd = (const cmd_buffer_base*)header;
+			gl_bind_buffer_base(cmd->target, cmd->index, cmd->buffer);
+			break;
+		}
+		case CMD_BIND_VERTEX_BUFFER: {
+			const cmd_vertex_buffer* cmd = (const cmd_vertex_buffer*)header;
+			bind_vertex_buffer(cmd->format, cmd->binding, cmd->buffer, cmd->offset, cmd->stride);
+			break;
+		}
+		case CMD_BIND_TEXTURE: {
+			const cmd_texture* cmd = (const cmd_texture*)header;
+			gl_active_texture(cmd->unit);
+			gl_bind_texture(cmd->target, cmd->texture);
+			break;
+		}
+		case CMD_UNIFORM_INTS: {
+			const cmd_uniform_ints* cmd = (const cmd_uniform_ints*)header;
+			if (cmd->count == 1) { glUniform1i(cmd->location, cmd->v[0]); }
+			else { glUniform2i(cmd->location, cmd->v[0], cmd->v[1]); }
+			break;
+		}
+		case CMD_UNIFORMS: {
+			const cmd_uniform_data* cmd = (const cmd_uniform_data*)header;
+			uniform_alloc alloc = alloc_uniforms(ring, cmd->size);
+			if (!alloc.ptr) { break; }
+			memcpy(alloc.ptr, cmd + 1, cmd->size);
+			flush_uniform_ring(ring);
+			bind_uniforms(ring, cmd->target, cmd->binding, alloc);
+			break;
+		}
+		case CMD_DRAW_ARRAYS: {
+			const cmd_draw* cmd = (const cmd_draw*)header;
+			if (cmd->base_instance) {
+				glDrawArraysInstancedBaseInstance(cmd->mode, cmd->first, cmd->count, cmd->instances,
+												  cmd->base_instance);
+			}
+			else {
+				glDrawArraysInstanced(cmd->mode, cmd->first, cmd->count, cmd->instances);
+			}
+			draws++;
+			break;
+		}
+		case CMD_DRAW_BATCH: {
+			const cmd_batch* cmd = (const cmd_batch*)header;
+			draws += draw_static_batch(cmd->batch, cmd->first, cmd->count);
+			break;
+		}
+		case CMD_BEGIN_TIMER:
+			begin_gpu_timer(((const cmd_timer*)header)->timer);
+			break;
+		case CMD_END_TIMER:
+			end_gpu_timer(((const cmd_timer*)header)->timer);
+			break;
+		default:
+			gl_log_error("ERROR: Unknown command %u in command list\n", header->type);
+			return draws;
+		}
+	}
+	return draws;
+}
+
+/*
+ * Recording threads.
+ */
+static void record_lists(command_recorder* recorder) {
+	std::vector<command_list>& lists = *recorder->lists;
+	for (;;) {
+		int i = recorder->next.fetch_add(1);
+		if (i >= (int)lists.size()) { return; }
+		reset_command_list(&lists[i]);
+		(*recorder->record)(i, &lists[i]);
+	}
+}
+
+static void worker_loop(command_recorder* recorder) {
+	unsigned long seen = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(recorder->lock);
+			recorder->wake.wait(lock, [&] { return recorder->stop || recorder->generation != seen; });
+			if (recorder->stop) { return; }
+			seen = recorder->generation;
+		}
+		record_lists(recorder);
+		std::lock_guard<std::mutex> lock(recorder->lock);
+		if (--recorder->active == 0) { recorder->done.notify_one(); }
+	}
+}
+
+void init_command_recorder(command_recorder* recorder, int threads) {
+	if (threads < 0) { threads = (int)std::thread::hardware_concurrency() - 1; }
+	if (threads < 0) { threads = 0; }
+	recorder->stop = false;
+	recorder->generation = 0;
+	recorder->active = 0;
+	recorder->lists = NULL;
+	recorder->record = NULL;
+	recorder->next = 0;
+	for (int t=0; t<threads; t++) {
+		recorder->threads.push_back(std::thread(worker_loop, recorder));
+	}
+	gl_log("Command recording on %i thread(s)\n", threads + 1);
+}
+
+void destroy_command_recorder(command_recorder* recorder) {
+	{
+		std::lock_guard<std::mutex> lock(recorder->lock);
+		recorder->stop = true;
+	}
+	recorder->wake.notify_all();
+	for (unsigned int t=0; t<recorder->threads.size(); t++) {
+		recorder->threads[t].join();
+	}
+	recorder->threads.clear();
+}
+
+void record_command_lists(command_recorder* recorder, std::vector<command_list>* lists,
+						  const record_fn& record) {
+	recorder->lists = lists;
+	recorder->record = &record;
+	recorder->next = 0;
+	// Not worth waking anyone for one list.
+	if (recorder->threads.empty() || lists->size() < 2) {
+		record_lists(recorder);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(recorder->lock);
+		recorder->active = recorder->threads.size();
+		recorder->generation++;
+	}
+	recorder->wake.notify_all();
+	record_lists(recorder);
+	std::unique_lock<std::mutex> lock(recorder->lock);
+	recorder->done.wait(lock, [&] { return recorder->active == 0; });
+}
@@ -0,0 +1,101 @@
+#ifndef KESHI_COMMANDS
+#define KESHI_COMMANDS
+
+#include <GL/glew.h>
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct gpu_timer;
+struct static_batch;
+struct uniform_ring;
+struct vertex_format;
+
+#define CMD_USE_PROGRAM 0
+#define CMD_BIND_VAO 1
+#define CMD_BIND_BUFFER_BASE 2
+#define CMD_BIND_TEXTURE 3
+#define CMD_UNIFORM_INTS 4
+#define CMD_UNIFORMS 5
+#define CMD_DRAW_ARRAYS 6
+#define CMD_DRAW_BATCH 7
+#define CMD_BEGIN_TIMER 8
+#define CMD_END_TIMER 9
+#define CMD_BIND_VERTEX_BUFFER 10
+
+/*
+ * A recorded stream of GL work: plain structs packed one after another
+ * in a byte buffer, each starting with its type and size. Recording
+ * touches no GL at all, so any thread can fill a list; the thread that
+ * owns the context replays them, through the state cache (glstate.h),
+ * in whatever order it wants them drawn.
+ * Uniform data is copied into the list and only goes into the uniform
+ * ring at replay, since the ring belongs to the GL thread.
+ * Objects named in a list (programs, buffers, batches, timers) have to
+ * outlive its replay.
+ */
+struct command_list {
+	std::vector<uint64_t> data;
+	int commands;
+};
+
+void reset_command_list(command_list* list);
+void cmd_use_program(command_list* list, GLuint program);
+void cmd_bind_vao(command_list* list, GLuint vao);
+void cmd_bind_buffer_base(command_list* list, GLenum target, GLuint index, GLuint buffer);
+// bind_vertex_buffer() at replay (glresource.h).
+void cmd_bind_vertex_buffer(command_list* list, vertex_format* format, GLuint binding, GLuint buffer,
+							GLintptr offset, GLsizei stride);
+// 'unit' is GL_TEXTURE0 + i.
+void cmd_bind_texture(command_list* list, GLenum unit, GLenum target, GLuint texture);
+void cmd_uniform_1i(command_list* list, GLint location, GLint x);
+void cmd_uniform_2i(command_list* list, GLint location, GLint x, GLint y);
+// Returns 'size' bytes to fill in, valid until the next cmd_*() on the
+// list. At replay they're copied to the uniform ring and bound at
+// 'binding' with glBindBufferRange.
+void* cmd_uniforms(command_list* list, GLenum target, GLuint binding, int size);
+void cmd_draw_arrays(command_list* list, GLenum mode, GLint first, GLsizei count,
+					 GLsizei instances, GLuint base_instance);
+// draw_static_batch() at replay.
+void cmd_draw_batch(command_list* list, const static_batch* batch, int first, int count);
+void cmd_begin_gpu_timer(command_list* list, gpu_timer* timer);
+void cmd_end_gpu_timer(command_list* list, gpu_timer* timer);
+// GL thread only. Returns the number of draw calls made.
+int replay_command_list(const command_list* list, uniform_ring* ring);
+
+/*
+ * Worker threads for recording. record_command_lists() resets each list
+ * and calls record(i, &lists[i]) once per list, spread over the workers
+ * and the calling thread, and returns when they're all done. Workers
+ * sleep between calls.
+ */
+typedef std::function<void(int, command_list*)> record_fn;
+
+struct command_recorder {
+	std::vector<std::thread> threads;
+	std::mutex lock;
+	std::condition_variable wake;
+	std::condition_variable done;
+	bool stop;
+	unsigned long generation;
+	// Workers still on the current generation.
+	int active;
+	// The current job; only touched while every worker is asleep.
+	std::vector<command_list>* lists;
+	const record_fn* record;
+	std::atomic<int> next;
+};
+
+// 'threads' workers besides the caller; -1 for one less than the cores.
+void init_command_recorder(command_recorder* recorder, int threads);
+void destroy_command_recorder(command_recorder* recorder);
+void record_command_lists(command_recorder* recorder, std::vector<command_list>* lists,
+						  const record_fn& record);
+
+#endif
@@ -0,0 +1,146 @@
+#include "framepacing.h"
+
+#include <GLFW/glfw3.h>
+
+#include <chrono>
+#include <thread>
+
+#include "util.h"
+
+// Bounds on how early a capped frame stops sleeping and starts spinning.
+#define MIN_SPIN_SEC 0.0002
+#define MAX_SPIN_SEC 0.004
+// Frames between GL clock calibrations; the clocks drift a little.
+#define CALIBRATE_FRAMES 600
+// Don't hang on a lost context.
+#define LAST_FRAME_TIMEOUT_NS 1000000000ull
+
+static const char* pace_names[] = { "vsync", "uncapped", "capped" };
+
+// Where the GL clock is against ours, right now.
+static void calibrate(frame_pacer* pacer) {
+	GLint64 gl_ns = 0;
+	glGetInteger64v(GL_TIMESTAMP, &gl_ns);
+	pacer->gl_clock_offset = glfwGetTime() - gl_ns / 1000000000.0;
+	pacer->calibrate_in = CALIBRATE_FRAMES;
+}
+
+static void collect(frame_pacer* pacer, int i) {
+	GLuint64 gl_ns = 0;
+	glGetQueryObjectui64v(pacer->queries[i], GL_QUERY_RESULT, &gl_ns);
+	pacer->pending[i] = false;
+	double ms = (gl_ns / 1000000000.0 + pacer->gl_clock_offset - pacer->input_sec[i]) * 1000.0;
+	if (ms < 0.0) { return; }
+	pacer->frames++;
+	pacer->total_ms += ms;
+	if (ms > pacer->max_ms) { pacer->max_ms = ms; }
+	pacer->recent_ms = (pacer->frames == 1) ? ms : pacer->recent_ms * 0.9 + ms * 0.1;
+}
+
+void init_frame_pacer(frame_pacer* pacer, int mode, double fps, bool late_latch) {
+	if (mode == FRAME_PACE_CAPPED && !(fps > 0.0)) {
+		gl_log_error("ERROR: Frame cap of %.2f fps, using vsync instead\n", fps);
+		mode = FRAME_PACE_VSYNC;
+	}
+	pacer->mode = mode;
+	pacer->late_latch = late_latch;
+	pacer->frame_sec = (mode == FRAME_PACE_CAPPED) ? 1.0 / fps : 0.0;
+	pacer->deadline = 0.0;
+	pacer->spin_sec = 0.001;
+	pacer->late_frames = 0;
+	glGenQueries(FRAME_LATENCY_SLOTS, pacer->queries);
+	for (int i=0; i<FRAME_LATENCY_SLOTS; i++) {
+		pacer->pending[i] = false;
+		pacer->input_sec[i] = 0.0;
+	}
+	pacer->next = 0;
+	pacer->last_input_sec = glfwGetTime();
+	pacer->last_frame = 0;
+	pacer->frames = 0;
+	pacer->total_ms = 0.0;
+	pacer->max_ms = 0.0;
+	pacer->recent_ms = 0.0;
+	calibrate(pacer);
+
+	glfwSwapInterval((mode == FRAME_PACE_VSYNC) ? 1 : 0);
+	if (mode == FRAME_PACE_CAPPED) {
+		gl_log("Frame pacing: capped at %.2f fps%s\n", fps, late_latch ? ", late latching" : "");
+	}
+	else {
+		gl_log("Frame pacing: %s%s\n", pace_names[mode], late_latch ? ", late latching" : "");
+	}
+}
+
+void wait_for_frame(frame_pacer* pacer) {
+	if (pacer->last_frame) {
+		glClientWaitSync(pacer->last_frame, GL_SYNC_FLUSH_COMMANDS_BIT, LAST_FRAME_TIMEOUT_NS);
+		glDeleteSync(pacer->last_frame);
+		pacer->last_frame = 0;
+	}
+	if (pacer->mode != FRAME_PACE_CAPPED) { return; }
+
+	double now = glfwGetTime();
+	if (now >= pacer->deadline) {
+		// Missed it. Start the schedule over from here rather than rush
+		// out a burst of frames to catch up.
+		if (pacer->deadline > 0.0) { pacer->late_frames++; }
+		pacer->deadline = now + pacer->frame_sec;
+		return;
+	}
+	double wake = pacer->deadline - pacer->spin_sec;
+	if (wake > now) {
+		std::this_thread::sleep_for(std::chrono::duration<double>(wake - now));
+		double overslept = glfwGetTime() - wake;
+		if (overslept > pacer->spin_sec) {
+			pacer->spin_sec = (overslept * 1.25 < MAX_SPIN_SEC) ? overslept * 1.25 : MAX_SPIN_SEC;
+		}
+		else if (pacer->spin_sec * 0.99 > MIN_SPIN_SEC) {
+			pacer->spin_sec *= 0.99;
+		}
+	}
+	while (glfwGetTime() < pacer->deadline) {}
+	pacer->deadline += pacer->frame_sec;
+}
+
+void mark_input_sampled(frame_pacer* pacer) {
+	pacer->last_input_sec = glfwGetTime();
+}
+
+void mark_frame_presented(frame_pacer* pacer) {
+	int i = pacer->next;
+	// Out of slots; this one's a few frames old, so it's done anyway.
+	if (pacer->pending[i]) { collect(pacer, i); }
+	glQueryCounter(pacer->queries[i], GL_TIMESTAMP);
+	pacer->input_sec[i] = pacer->last_input_sec;
+	pacer->pending[i] = true;
+	pacer->next = (i + 1) % FRAME_LATENCY_SLOTS;
+	if (pacer->late_latch) {
+		pacer->last_frame = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	for (int j=0; j<FRAME_LATENCY_SLOTS; j++) {
+		if (!pacer->pending[j]) { continue; }
+		GLint ready = GL_FALSE;
+		glGetQueryObjectiv(pacer->queries[j], GL_QUERY_RESULT_AVAILABLE, &ready);
+		if (ready) { collect(pacer, j); }
+	}
+	if (--pacer->calibrate_in == 0) { calibrate(pacer); }
+}
+
+void log_frame_pacing(const frame_pacer* pacer) {
+	double average_ms = pacer->frames ? pacer->total_ms / pacer->frames : 0.0;
+	gl_log("Frame pacing, %s: input to present %.2fms average, %.2fms worst over %lu frames\n",
+		   pace_names[pacer->mode], average_ms, pacer->max_ms, pacer->frames);
+	if (pacer->mode == FRAME_PACE_CAPPED) {
+		gl_log("Frame pacing: %lu frame(s) started late, spinning the last %.3fms\n",
+			   pacer->late_frames, pacer->spin_sec * 1000.0);
+	}
+}
+
+void destroy_frame_pacer(frame_pacer* pacer) {
+	if (pacer->last_frame) {
+		glDeleteSync(pacer->last_frame);
+		pacer->last_frame = 0;
+	}
+	glDeleteQueries(FRAME_LATENCY_SLOTS, pacer->queries);
+}
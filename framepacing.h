@@ -0,0 +1,61 @@
+#ifndef KESHI_FRAMEPACING
+#define KESHI_FRAMEPACING
+
+#include <GL/glew.h>
+
+#define FRAME_PACE_VSYNC 0
+#define FRAME_PACE_UNCAPPED 1
+#define FRAME_PACE_CAPPED 2
+
+// Frames of latency queries in flight, as with gpu_timer.
+#define FRAME_LATENCY_SLOTS 4
+
+/*
+ * When frames start and how long input waits to be seen.
+ * Vsync and uncapped just set the swap interval. Capped sleeps to a
+ * little before each frame's start time and spins the rest of the way,
+ * since a plain sleep can wake up a good fraction of a millisecond late;
+ * the spin margin grows to cover the worst oversleep seen.
+ * With late latching, each frame also waits for the last one to finish
+ * on the GPU before it starts, so frames don't queue up in the driver,
+ * and the caller samples input right before submitting (see main.cpp).
+ * Latency is from mark_input_sampled() to a GL_TIMESTAMP query written
+ * after the swap, i.e. when the GPU is done with the frame, which is as
+ * close to present as GL can tell us.
+ */
+struct frame_pacer {
+	int mode;
+	bool late_latch;
+	double frame_sec;
+	double deadline;
+	double spin_sec;
+	unsigned long late_frames;
+	// Latency queries, with when the input they measure was sampled.
+	GLuint queries[FRAME_LATENCY_SLOTS];
+	double input_sec[FRAME_LATENCY_SLOTS];
+	bool pending[FRAME_LATENCY_SLOTS];
+	int next;
+	double last_input_sec;
+	// glfwGetTime() minus the GL timestamp, in seconds.
+	double gl_clock_offset;
+	unsigned long calibrate_in;
+	GLsync last_frame;
+	unsigned long frames;
+	double total_ms;
+	double max_ms;
+	// Smoothed, for the window title.
+	double recent_ms;
+};
+
+// 'fps' is only for FRAME_PACE_CAPPED. Needs the context current.
+void init_frame_pacer(frame_pacer* pacer, int mode, double fps, bool late_latch);
+// Top of the frame.
+void wait_for_frame(frame_pacer* pacer);
+// Right after polling the input this frame shows.
+void mark_input_sampled(frame_pacer* pacer);
+// Right after glfwSwapBuffers().
+void mark_frame_presented(frame_pacer* pacer);
+void log_frame_pacing(const frame_pacer* pacer);
+void destroy_frame_pacer(frame_pacer* pacer);
+
+#endif
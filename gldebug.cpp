@@ -0,0 +1,210 @@
+#include "gldebug.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#include "glstate.h"
+#include "util.h"
+
+static_assert((GL_DEBUG_MAX_IDS & (GL_DEBUG_MAX_IDS - 1)) == 0, "GL_DEBUG_MAX_IDS must be a power of two");
+
+struct debug_id {
+	bool used;
+	GLenum source, type, severity;
+	GLuint id;
+	unsigned long count;
+	// 'count' when this id last made it into the log.
+	unsigned long logged_count;
+	double logged_at;
+};
+
+// Async output calls back from driver threads, hence the lock.
+static std::mutex ids_lock;
+static debug_id ids[GL_DEBUG_MAX_IDS];
+static gl_debug_stats stats;
+static gl_debug_settings settings;
+static std::chrono::steady_clock::time_point start;
+
+static const char* source_name(GLenum source) {
+	switch (source) {
+	case GL_DEBUG_SOURCE_API:             return "api";
+	case GL_DEBUG_SOURCE_WINDOW_SYSTEM:   return "window";
+	case GL_DEBUG_SOURCE_SHADER_COMPILER: return "compiler";
+	case GL_DEBUG_SOURCE_THIRD_PARTY:     return "third party";
+	case GL_DEBUG_SOURCE_APPLICATION:     return "app";
+	default:                              return "other";
+	}
+}
+
+static const char* type_name(GLenum type) {
+	switch (type) {
+	case GL_DEBUG_TYPE_ERROR:               return "error";
+	case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated";
+	case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:  return "undefined";
+	case GL_DEBUG_TYPE_PORTABILITY:         return "portability";
+	case GL_DEBUG_TYPE_PERFORMANCE:         return "performance";
+	case GL_DEBUG_TYPE_MARKER:              return "marker";
+	default:                                return "other";
+	}
+}
+
+static const char* severity_name(GLenum severity) {
+	switch (severity) {
+	case GL_DEBUG_SEVERITY_HIGH:   return "high";
+	case GL_DEBUG_SEVERITY_MEDIUM: return "medium";
+	case GL_DEBUG_SEVERITY_LOW:    return "low";
+	default:                       return "note";
+	}
+}
+
+// Open addressing on (source, id); NULL once the table is full.
+static debug_id* find_id(GLenum source, GLenum type, GLenum severity, GLuint id) {
+	unsigned int h = (id * 2654435761u) ^ source;
+	for (int i=0; i<GL_DEBUG_MAX_IDS; i++) {
+		debug_id* d = &ids[(h + i) & (GL_DEBUG_MAX_IDS - 1)];
+		if (d->used && d->source == source && d->id == id) { return d; }
+		if (!d->used) {
+			d->used = true;
+			d->source = source;
+			d->type = type;
+			d->severity = severity;
+			d->id = id;
+			d->count = 0;
+			d->logged_count = 0;
+			d->logged_at = 0.0;
+			stats.ids++;
+			return d;
+		}
+	}
+	return NULL;
+}
+
+static double seconds_since_start() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int init_gl_debug(const gl_debug_settings* gl_settings) {
+	if (!gl_caps.khr_debug) {
+		gl_log("No KHR_debug, so no GL debug output.\n");
+		return 1;
+	}
+	settings = *gl_settings;
+	start = std::chrono::steady_clock::now();
+
+	gl_enable(GL_DEBUG_OUTPUT);
+	glDebugMessageCallback(gl_debug_callback, NULL);
+
+	// Everything, less what's under the minimum severity and group markers.
+	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, NULL, GL_TRUE);
+	GLenum severities[] = {
+		GL_DEBUG_SEVERITY_NOTIFICATION, GL_DEBUG_SEVERITY_LOW,
+		GL_DEBUG_SEVERITY_MEDIUM, GL_DEBUG_SEVERITY_HIGH
+	};
+	for (int i=0; i<4 && severities[i] != settings.min_severity; i++) {
+		glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, severities[i], 0, NULL, GL_FALSE);
+	}
+	glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_PUSH_GROUP, GL_DONT_CARE, 0, NULL, GL_FALSE);
+	glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_POP_GROUP, GL_DONT_CARE, 0, NULL, GL_FALSE);
+	// NVIDIA's "buffer will use VIDEO memory" on every buffer upload.
+	mute_gl_debug_id(GL_DEBUG_SOURCE_API, GL_DEBUG_TYPE_OTHER, 131185);
+
+	if (settings.break_on_error) {
+		gl_enable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	}
+	else {
+		gl_disable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	}
+	gl_log("GL debug output on: %s severity and up, %s.\n",
+		   severity_name(settings.min_severity),
+		   settings.break_on_error ? "synchronous, breaking on errors" : "asynchronous");
+	return 0;
+}
+
+void mute_gl_debug_id(GLenum source, GLenum type, GLuint id) {
+	glDebugMessageControl(source, type, GL_DONT_CARE, 1, &id, GL_FALSE);
+}
+
+void GLAPIENTRY gl_debug_callback(GLenum source, GLenum type, GLuint id,
+								  GLenum severity, GLsizei length,
+								  const GLchar* message, const void* user_param) {
+	bool log = true;
+	unsigned long repeats = 0;
+	{
+		std::lock_guard<std::mutex> lock(ids_lock);
+		stats.messages++;
+		debug_id* d = find_id(source, type, severity, id);
+		if (d) {
+			d->count++;
+			double now = seconds_since_start();
+			if (d->count > GL_DEBUG_BURST) {
+				log = now - d->logged_at >= GL_DEBUG_INTERVAL;
+				repeats = d->count - d->logged_count - 1;
+			}
+			if (log) {
+				d->logged_count = d->count;
+				d->logged_at = now;
+			}
+		}
+		if (log) { stats.logged++; }
+	}
+
+	if (log) {
+		// Drivers are inconsistent about the length and trailing newlines.
+		char text[1024];
+		int len = (length >= 0) ? length : (int)strlen(message);
+		while (len > 0 && (message[len-1] == '\n' || message[len-1] == '\r')) { len--; }
+		snprintf(text, sizeof(text), "%.*s", len, message);
+
+		if (repeats) {
+			log_warn(LOG_GL, "GL %s %s (%s) %u: %s [+%lu more since]\n", source_name(source),
+					 type_name(type), severity_name(severity), id, text, repeats);
+		}
+		else if (type == GL_DEBUG_TYPE_ERROR || severity == GL_DEBUG_SEVERITY_HIGH) {
+			log_error(LOG_GL, "GL %s %s (%s) %u: %s\n", source_name(source), type_name(type),
+					  severity_name(severity), id, text);
+		}
+		else {
+			log_warn(LOG_GL, "GL %s %s (%s) %u: %s\n", source_name(source), type_name(type),
+					 severity_name(severity), id, text);
+		}
+	}
+
+	if (settings.break_on_error && type == GL_DEBUG_TYPE_ERROR) {
+		flush_gl_log();
+		raise(SIGTRAP);
+	}
+}
+
+gl_debug_stats get_gl_debug_stats() {
+	std::lock_guard<std::mutex> lock(ids_lock);
+	return stats;
+}
+
+static bool more_frequent(const debug_id& a, const debug_id& b) {
+	return a.count > b.count;
+}
+
+void log_gl_debug_stats() {
+	std::vector<debug_id> seen;
+	gl_debug_stats totals;
+	{
+		std::lock_guard<std::mutex> lock(ids_lock);
+		for (int i=0; i<GL_DEBUG_MAX_IDS; i++) {
+			if (ids[i].used) { seen.push_back(ids[i]); }
+		}
+		totals = stats;
+	}
+	std::sort(seen.begin(), seen.end(), more_frequent);
+	gl_log("GL debug: %lu messages from %lu ids, %lu logged\n",
+		   totals.messages, totals.ids, totals.logged);
+	for (unsigned int i=0; i<seen.size(); i++) {
+		gl_log("  %-8lu %s %s (%s) %u\n", seen[i].count, source_name(seen[i].source),
+			   type_name(seen[i].type), severity_name(seen[i].severity), seen[i].id);
+	}
+}
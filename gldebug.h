@@ -0,0 +1,49 @@
+#ifndef KESHI_GLDEBUG
+#define KESHI_GLDEBUG
+
+#include <GL/glew.h>
+
+// Distinct (source, id) pairs tracked; anything past this is logged
+// without deduplication.
+#define GL_DEBUG_MAX_IDS 256
+// Each id logs its first few messages in full...
+#define GL_DEBUG_BURST 5
+// ...and after that at most one line per this many seconds, carrying
+// the count of the copies it stood in for.
+#define GL_DEBUG_INTERVAL 2.0
+
+/*
+ * KHR_debug message handling.
+ * glDebugMessageControl drops notifications and group markers in the
+ * driver, before they ever reach us. Messages that do arrive are
+ * counted per (source, id); repeats are rate limited, so a warning
+ * raised every draw call costs a counter increment rather than a log
+ * line. Output is asynchronous by default, since
+ * GL_DEBUG_OUTPUT_SYNCHRONOUS serializes the driver; with
+ * break_on_error it's synchronous and errors raise SIGTRAP, so a
+ * debugger stops on the offending call.
+ */
+struct gl_debug_settings {
+	bool break_on_error;
+	// Least severe message that gets through, e.g. GL_DEBUG_SEVERITY_LOW.
+	GLenum min_severity;
+};
+
+struct gl_debug_stats {
+	unsigned long messages;
+	unsigned long logged;
+	unsigned long ids;
+};
+
+int init_gl_debug(const gl_debug_settings* settings);
+// Mutes one message id from a driver that won't stop talking.
+void mute_gl_debug_id(GLenum source, GLenum type, GLuint id);
+gl_debug_stats get_gl_debug_stats();
+// Per-id totals, most frequent first.
+void log_gl_debug_stats();
+
+void GLAPIENTRY gl_debug_callback(GLenum source, GLenum type, GLuint id,
+								  GLenum severity, GLsizei length,
+								  const GLchar* message, const void* user_param);
+
+#endif
@@ -0,0 +1,209 @@
+#include "glresource.h"
+
+#include "glstate.h"
+#include "util.h"
+
+/*
+ * Buffers.
+ */
+GLuint create_buffer(GLsizeiptr size, const void* data, GLbitfield flags) {
+	GLuint buffer = 0;
+	if (gl_caps.direct_state_access) {
+		glCreateBuffers(1, &buffer);
+		glNamedBufferStorage(buffer, size, data, flags);
+		return buffer;
+	}
+	glGenBuffers(1, &buffer);
+	gl_bind_buffer(GL_COPY_WRITE_BUFFER, buffer);
+	if (gl_caps.buffer_storage) {
+		glBufferStorage(GL_COPY_WRITE_BUFFER, size, data, flags);
+	}
+	else {
+		glBufferData(GL_COPY_WRITE_BUFFER, size, data, flags ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+	}
+	return buffer;
+}
+
+GLuint create_mutable_buffer(GLsizeiptr size, const void* data, GLenum usage) {
+	GLuint buffer = 0;
+	if (gl_caps.direct_state_access) { glCreateBuffers(1, &buffer); }
+	else { glGenBuffers(1, &buffer); }
+	set_buffer_data(buffer, size, data, usage);
+	return buffer;
+}
+
+void set_buffer_data(GLuint buffer, GLsizeiptr size, const void* data, GLenum usage) {
+	if (gl_caps.direct_state_access) {
+		glNamedBufferData(buffer, size, data, usage);
+		return;
+	}
+	gl_bind_buffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, size, data, usage);
+}
+
+void set_buffer_sub_data(GLuint buffer, GLintptr offset, GLsizeiptr size, const void* data) {
+	if (gl_caps.direct_state_access) {
+		glNamedBufferSubData(buffer, offset, size, data);
+		return;
+	}
+	gl_bind_buffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+}
+
+void* map_buffer_range(GLuint buffer, GLintptr offset, GLsizeiptr size, GLbitfield access) {
+	if (gl_caps.direct_state_access) {
+		return glMapNamedBufferRange(buffer, offset, size, access);
+	}
+	gl_bind_buffer(GL_COPY_WRITE_BUFFER, buffer);
+	return glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, size, access);
+}
+
+void delete_buffer(GLuint* buffer) {
+	if (!*buffer) { return; }
+	gl_forget_buffer(*buffer);
+	glDeleteBuffers(1, buffer);
+	*buffer = 0;
+}
+
+/*
+ * Textures. The bind path leaves the texture bound on the active unit.
+ */
+GLuint create_texture_2d(GLsizei levels, GLenum internal_format, GLsizei w, GLsizei h) {
+	GLuint tex = 0;
+	if (gl_caps.direct_state_access) {
+		glCreateTextures(GL_TEXTURE_2D, 1, &tex);
+		glTextureStorage2D(tex, levels, internal_format, w, h);
+	}
+	else {
+		glGenTextures(1, &tex);
+		gl_bind_texture(GL_TEXTURE_2D, tex);
+		glTexStorage2D(GL_TEXTURE_2D, levels, internal_format, w, h);
+	}
+	return tex;
+}
+
+void texture_sub_image_2d(GLuint tex, GLint level, GLsizei w, GLsizei h,
+						  GLenum format, GLenum type, const void* pixels) {
+	if (gl_caps.direct_state_access) {
+		glTextureSubImage2D(tex, level, 0, 0, w, h, format, type, pixels);
+		return;
+	}
+	gl_bind_texture(GL_TEXTURE_2D, tex);
+	glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, w, h, format, type, pixels);
+}
+
+void compressed_texture_sub_image_2d(GLuint tex, GLint level, GLsizei w, GLsizei h,
+									 GLenum format, GLsizei size, const void* data) {
+	if (gl_caps.direct_state_access) {
+		glCompressedTextureSubImage2D(tex, level, 0, 0, w, h, format, size, data);
+		return;
+	}
+	gl_bind_texture(GL_TEXTURE_2D, tex);
+	glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, w, h, format, size, data);
+}
+
+void texture_parameteri(GLuint tex, GLenum pname, GLint value) {
+	if (gl_caps.direct_state_access) {
+		glTextureParameteri(tex, pname, value);
+		return;
+	}
+	gl_bind_texture(GL_TEXTURE_2D, tex);
+	glTexParameteri(GL_TEXTURE_2D, pname, value);
+}
+
+void generate_texture_mipmap(GLuint tex) {
+	if (gl_caps.direct_state_access) {
+		glGenerateTextureMipmap(tex);
+		return;
+	}
+	gl_bind_texture(GL_TEXTURE_2D, tex);
+	glGenerateMipmap(GL_TEXTURE_2D);
+}
+
+/*
+ * Vertex formats. Without DSA the same separate format/binding calls
+ * (core in 4.3) go through the bound VAO.
+ */
+void init_vertex_format(vertex_format* format) {
+	format->num_attribs = 0;
+	format->vao = 0;
+	for (int b=0; b<VERTEX_FORMAT_MAX_BINDINGS; b++) {
+		format->divisors[b] = 0;
+		format->buffers[b] = 0;
+		format->offsets[b] = 0;
+		format->strides[b] = 0;
+	}
+}
+
+void add_vertex_attrib(vertex_format* format, GLuint location, GLint size, GLenum type,
+					   GLuint binding, GLuint offset) {
+	if (format->num_attribs == VERTEX_FORMAT_MAX_ATTRIBS || binding >= VERTEX_FORMAT_MAX_BINDINGS) {
+		gl_log_error("ERROR: Vertex format can't take attribute %u at binding %u\n", location, binding);
+		return;
+	}
+	vertex_attrib a = { location, size, type, offset, binding };
+	format->attribs[format->num_attribs++] = a;
+}
+
+void set_vertex_binding_divisor(vertex_format* format, GLuint binding, GLuint divisor) {
+	if (binding < VERTEX_FORMAT_MAX_BINDINGS) { format->divisors[binding] = divisor; }
+}
+
+void build_vertex_format(vertex_format* format) {
+	bool dsa = gl_caps.direct_state_access;
+	if (dsa) { glCreateVertexArrays(1, &format->vao); }
+	else {
+		glGenVertexArrays(1, &format->vao);
+		gl_bind_vao(format->vao);
+	}
+	for (int i=0; i<format->num_attribs; i++) {
+		const vertex_attrib& a = format->attribs[i];
+		if (dsa) {
+			glVertexArrayAttribFormat(format->vao, a.location, a.size, a.type, GL_FALSE, a.offset);
+			glVertexArrayAttribBinding(format->vao, a.location, a.binding);
+			glEnableVertexArrayAttrib(format->vao, a.location);
+		}
+		else {
+			glVertexAttribFormat(a.location, a.size, a.type, GL_FALSE, a.offset);
+			glVertexAttribBinding(a.location, a.binding);
+			glEnableVertexAttribArray(a.location);
+		}
+	}
+	for (GLuint b=0; b<VERTEX_FORMAT_MAX_BINDINGS; b++) {
+		if (!format->divisors[b]) { continue; }
+		if (dsa) { glVertexArrayBindingDivisor(format->vao, b, format->divisors[b]); }
+		else { glVertexBindingDivisor(b, format->divisors[b]); }
+	}
+}
+
+void bind_vertex_buffer(vertex_format* format, GLuint binding, GLuint buffer,
+						GLintptr offset, GLsizei stride) {
+	if (format->buffers[binding] == buffer && format->offsets[binding] == offset &&
+		format->strides[binding] == stride) {
+		return;
+	}
+	if (gl_caps.direct_state_access) {
+		glVertexArrayVertexBuffer(format->vao, binding, buffer, offset, stride);
+	}
+	else {
+		gl_bind_vao(format->vao);
+		glBindVertexBuffer(binding, buffer, offset, stride);
+	}
+	format->buffers[binding] = buffer;
+	format->offsets[binding] = offset;
+	format->strides[binding] = stride;
+}
+
+void detach_vertex_buffer(vertex_format* format, GLuint buffer) {
+	if (!buffer) { return; }
+	for (GLuint b=0; b<VERTEX_FORMAT_MAX_BINDINGS; b++) {
+		if (format->buffers[b] == buffer) { bind_vertex_buffer(format, b, 0, 0, 0); }
+	}
+}
+
+void destroy_vertex_format(vertex_format* format) {
+	if (!format->vao) { return; }
+	gl_forget_vao(format->vao);
+	glDeleteVertexArrays(1, &format->vao);
+	init_vertex_format(format);
+}
@@ -0,0 +1,77 @@
+#ifndef KESHI_GLRESOURCE
+#define KESHI_GLRESOURCE
+
+#include <GL/glew.h>
+
+#define VERTEX_FORMAT_MAX_ATTRIBS 8
+#define VERTEX_FORMAT_MAX_BINDINGS 4
+
+/*
+ * Buffer, texture and vertex array setup, two ways: with direct state
+ * access (GL 4.5 or ARB_direct_state_access) objects are created and
+ * edited by name, glCreate* and glNamed*; without it, they're bound to
+ * a scratch target (GL_COPY_WRITE_BUFFER for buffers) and edited there.
+ * Which one is decided once by gl_ext_check() (gl_caps.direct_state_access).
+ */
+
+// Immutable storage if the driver has it; 'flags' as for glBufferStorage,
+// 0 for data that never changes.
+GLuint create_buffer(GLsizeiptr size, const void* data, GLbitfield flags);
+// Storage that can be respecified with set_buffer_data().
+GLuint create_mutable_buffer(GLsizeiptr size, const void* data, GLenum usage);
+void set_buffer_data(GLuint buffer, GLsizeiptr size, const void* data, GLenum usage);
+void set_buffer_sub_data(GLuint buffer, GLintptr offset, GLsizeiptr size, const void* data);
+void* map_buffer_range(GLuint buffer, GLintptr offset, GLsizeiptr size, GLbitfield access);
+// Forgets it in the state cache too, and zeroes the name.
+void delete_buffer(GLuint* buffer);
+
+// 2D textures with immutable storage.
+GLuint create_texture_2d(GLsizei levels, GLenum internal_format, GLsizei w, GLsizei h);
+void texture_sub_image_2d(GLuint tex, GLint level, GLsizei w, GLsizei h,
+						  GLenum format, GLenum type, const void* pixels);
+void compressed_texture_sub_image_2d(GLuint tex, GLint level, GLsizei w, GLsizei h,
+									 GLenum format, GLsizei size, const void* data);
+void texture_parameteri(GLuint tex, GLenum pname, GLint value);
+void generate_texture_mipmap(GLuint tex);
+
+/*
+ * A vertex layout, apart from the buffers it reads: attributes name a
+ * binding point and an offset, and buffers are attached to binding
+ * points with their stride. Every mesh in the same layout draws from the
+ * one VAO; switching meshes is a bind_vertex_buffer() per binding, which
+ * is skipped when it's already attached.
+ */
+struct vertex_attrib {
+	GLuint location;
+	GLint size;
+	GLenum type;
+	GLuint offset;
+	GLuint binding;
+};
+
+struct vertex_format {
+	vertex_attrib attribs[VERTEX_FORMAT_MAX_ATTRIBS];
+	int num_attribs;
+	GLuint divisors[VERTEX_FORMAT_MAX_BINDINGS];
+	GLuint vao;
+	// What's attached to each binding point.
+	GLuint buffers[VERTEX_FORMAT_MAX_BINDINGS];
+	GLintptr offsets[VERTEX_FORMAT_MAX_BINDINGS];
+	GLsizei strides[VERTEX_FORMAT_MAX_BINDINGS];
+};
+
+void init_vertex_format(vertex_format* format);
+void add_vertex_attrib(vertex_format* format, GLuint location, GLint size, GLenum type,
+					   GLuint binding, GLuint offset);
+// 1 to step the binding's buffers per instance instead of per vertex.
+void set_vertex_binding_divisor(vertex_format* format, GLuint binding, GLuint divisor);
+// Creates the VAO; once, after the attributes are in.
+void build_vertex_format(vertex_format* format);
+void bind_vertex_buffer(vertex_format* format, GLuint binding, GLuint buffer,
+						GLintptr offset, GLsizei stride);
+// Before deleting an attached buffer: a VAO that isn't bound keeps the
+// deleted storage, and the name can come back from the next glCreate*.
+void detach_vertex_buffer(vertex_format* format, GLuint buffer);
+void destroy_vertex_format(vertex_format* format);
+
+#endif
@@ -0,0 +1,254 @@
+#include "glstate.h"
+
+#include "util.h"
+
+#define UNKNOWN 0xFFFFFFFFu
+
+static const GLenum buffer_targets[] = {
+	GL_ARRAY_BUFFER, GL_UNIFORM_BUFFER, GL_SHADER_STORAGE_BUFFER, GL_DRAW_INDIRECT_BUFFER,
+	GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, GL_PIXEL_UNPACK_BUFFER
+};
+#define NUM_BUFFER_TARGETS (int)(sizeof(buffer_targets) / sizeof(buffer_targets[0]))
+
+static const GLenum texture_targets[] = { GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY };
+#define NUM_TEXTURE_TARGETS (int)(sizeof(texture_targets) / sizeof(texture_targets[0]))
+
+static const GLenum caps[] = {
+	GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND, GL_SCISSOR_TEST, GL_MULTISAMPLE,
+	GL_FRAMEBUFFER_SRGB, GL_DEBUG_OUTPUT, GL_DEBUG_OUTPUT_SYNCHRONOUS
+};
+#define NUM_CAPS (int)(sizeof(caps) / sizeof(caps[0]))
+
+static const char* kind_names[GL_STATE_KINDS] = {
+	"program", "vao", "buffer", "indexed buffer", "active texture", "texture", "viewport", "enable"
+};
+
+// glBindBufferBase is a range of size -1 here.
+struct indexed_binding {
+	GLuint buffer;
+	GLintptr offset;
+	GLsizeiptr size;
+};
+
+struct shadow_state {
+	GLuint program;
+	GLuint vao;
+	GLuint buffers[NUM_BUFFER_TARGETS];
+	indexed_binding uniform_buffers[GL_STATE_MAX_INDEXED];
+	indexed_binding storage_buffers[GL_STATE_MAX_INDEXED];
+	GLuint active_unit;
+	GLuint textures[GL_STATE_MAX_TEXTURE_UNITS][NUM_TEXTURE_TARGETS];
+	GLint viewport[4];
+	bool viewport_known;
+	// A bit per entry of caps[].
+	unsigned int enabled;
+	unsigned int known;
+};
+
+static shadow_state shadow;
+static gl_state_stats stats;
+static bool initialized = false;
+
+static int find(const GLenum* list, int count, GLenum value) {
+	for (int i=0; i<count; i++) {
+		if (list[i] == value) { return i; }
+	}
+	return -1;
+}
+
+// True if the call has to happen.
+static bool changed(int kind, bool differs) {
+	if (differs) { stats.issued[kind]++; }
+	else { stats.elided[kind]++; }
+	return differs;
+}
+
+void reset_gl_state() {
+	shadow.program = UNKNOWN;
+	shadow.vao = UNKNOWN;
+	for (int i=0; i<NUM_BUFFER_TARGETS; i++) { shadow.buffers[i] = UNKNOWN; }
+	for (int i=0; i<GL_STATE_MAX_INDEXED; i++) {
+		shadow.uniform_buffers[i].buffer = UNKNOWN;
+		shadow.storage_buffers[i].buffer = UNKNOWN;
+	}
+	shadow.active_unit = UNKNOWN;
+	for (int u=0; u<GL_STATE_MAX_TEXTURE_UNITS; u++) {
+		for (int t=0; t<NUM_TEXTURE_TARGETS; t++) { shadow.textures[u][t] = UNKNOWN; }
+	}
+	shadow.viewport_known = false;
+	shadow.enabled = shadow.known = 0;
+	initialized = true;
+}
+
+static void check_init() {
+	if (!initialized) { reset_gl_state(); }
+}
+
+void gl_use_program(GLuint program) {
+	check_init();
+	if (changed(GL_STATE_PROGRAM, shadow.program != program)) {
+		glUseProgram(program);
+		shadow.program = program;
+	}
+}
+
+void gl_bind_vao(GLuint vao) {
+	check_init();
+	if (changed(GL_STATE_VAO, shadow.vao != vao)) {
+		glBindVertexArray(vao);
+		shadow.vao = vao;
+	}
+}
+
+void gl_bind_buffer(GLenum target, GLuint buffer) {
+	check_init();
+	// Untracked, including GL_ELEMENT_ARRAY_BUFFER, which belongs to the VAO.
+	int t = find(buffer_targets, NUM_BUFFER_TARGETS, target);
+	if (t < 0) {
+		stats.issued[GL_STATE_BUFFER]++;
+		glBindBuffer(target, buffer);
+		return;
+	}
+	if (changed(GL_STATE_BUFFER, shadow.buffers[t] != buffer)) {
+		glBindBuffer(target, buffer);
+		shadow.buffers[t] = buffer;
+	}
+}
+
+static indexed_binding* indexed_slot(GLenum target, GLuint index) {
+	if (index >= GL_STATE_MAX_INDEXED) { return NULL; }
+	if (target == GL_UNIFORM_BUFFER) { return &shadow.uniform_buffers[index]; }
+	if (target == GL_SHADER_STORAGE_BUFFER) { return &shadow.storage_buffers[index]; }
+	return NULL;
+}
+
+// Indexed binds set the target's generic binding too.
+static void bound_generic(GLenum target, GLuint buffer) {
+	int t = find(buffer_targets, NUM_BUFFER_TARGETS, target);
+	if (t >= 0) { shadow.buffers[t] = buffer; }
+}
+
+void gl_bind_buffer_range(GLenum target, GLuint index, GLuint buffer,
+						  GLintptr offset, GLsizeiptr size) {
+	check_init();
+	indexed_binding* slot = indexed_slot(target, index);
+	bool differs = !slot || slot->buffer != buffer || slot->offset != offset || slot->size != size;
+	if (changed(GL_STATE_INDEXED_BUFFER, differs)) {
+		if (size < 0) { glBindBufferBase(target, index, buffer); }
+		else { glBindBufferRange(target, index, buffer, offset, size); }
+		if (slot) {
+			slot->buffer = buffer;
+			slot->offset = offset;
+			slot->size = size;
+		}
+		bound_generic(target, buffer);
+	}
+}
+
+void gl_bind_buffer_base(GLenum target, GLuint index, GLuint buffer) {
+	gl_bind_buffer_range(target, index, buffer, 0, -1);
+}
+
+void gl_active_texture(GLenum unit) {
+	check_init();
+	GLuint i = unit - GL_TEXTURE0;
+	if (changed(GL_STATE_ACTIVE_TEXTURE, shadow.active_unit != i)) {
+		glActiveTexture(unit);
+		shadow.active_unit = i;
+	}
+}
+
+void gl_bind_texture(GLenum target, GLuint texture) {
+	check_init();
+	int t = find(texture_targets, NUM_TEXTURE_TARGETS, target);
+	GLuint unit = shadow.active_unit;
+	if (t < 0 || unit >= GL_STATE_MAX_TEXTURE_UNITS) {
+		stats.issued[GL_STATE_TEXTURE]++;
+		glBindTexture(target, texture);
+		return;
+	}
+	if (changed(GL_STATE_TEXTURE, shadow.textures[unit][t] != texture)) {
+		glBindTexture(target, texture);
+		shadow.textures[unit][t] = texture;
+	}
+}
+
+void gl_viewport(GLint x, GLint y, GLsizei w, GLsizei h) {
+	check_init();
+	GLint* v = shadow.viewport;
+	bool differs = !shadow.viewport_known || v[0] != x || v[1] != y || v[2] != w || v[3] != h;
+	if (changed(GL_STATE_VIEWPORT, differs)) {
+		glViewport(x, y, w, h);
+		v[0] = x; v[1] = y; v[2] = w; v[3] = h;
+		shadow.viewport_known = true;
+	}
+}
+
+static void set_cap(GLenum cap, bool on) {
+	check_init();
+	int c = find(caps, NUM_CAPS, cap);
+	if (c < 0) {
+		stats.issued[GL_STATE_ENABLE]++;
+		if (on) { glEnable(cap); }
+		else { glDisable(cap); }
+		return;
+	}
+	unsigned int bit = 1u << c;
+	bool differs = !(shadow.known & bit) || ((shadow.enabled & bit) != 0) != on;
+	if (changed(GL_STATE_ENABLE, differs)) {
+		if (on) { glEnable(cap); }
+		else { glDisable(cap); }
+		shadow.known |= bit;
+		shadow.enabled = on ? (shadow.enabled | bit) : (shadow.enabled & ~bit);
+	}
+}
+
+void gl_enable(GLenum cap) { set_cap(cap, true); }
+void gl_disable(GLenum cap) { set_cap(cap, false); }
+
+/*
+ * Deletes. Anything that was bound to the name goes back to unknown.
+ */
+void gl_forget_program(GLuint program) {
+	if (shadow.program == program) { shadow.program = UNKNOWN; }
+}
+
+void gl_forget_vao(GLuint vao) {
+	if (shadow.vao == vao) { shadow.vao = UNKNOWN; }
+}
+
+void gl_forget_buffer(GLuint buffer) {
+	for (int i=0; i<NUM_BUFFER_TARGETS; i++) {
+		if (shadow.buffers[i] == buffer) { shadow.buffers[i] = UNKNOWN; }
+	}
+	for (int i=0; i<GL_STATE_MAX_INDEXED; i++) {
+		if (shadow.uniform_buffers[i].buffer == buffer) { shadow.uniform_buffers[i].buffer = UNKNOWN; }
+		if (shadow.storage_buffers[i].buffer == buffer) { shadow.storage_buffers[i].buffer = UNKNOWN; }
+	}
+}
+
+void gl_forget_texture(GLuint texture) {
+	for (int u=0; u<GL_STATE_MAX_TEXTURE_UNITS; u++) {
+		for (int t=0; t<NUM_TEXTURE_TARGETS; t++) {
+			if (shadow.textures[u][t] == texture) { shadow.textures[u][t] = UNKNOWN; }
+		}
+	}
+}
+
+gl_state_stats get_gl_state_stats() {
+	return stats;
+}
+
+void log_gl_state_stats(unsigned long frames) {
+	unsigned long issued = 0, elided = 0;
+	for (int k=0; k<GL_STATE_KINDS; k++) {
+		issued += stats.issued[k];
+		elided += stats.elided[k];
+	}
+	if (!frames) { frames = 1; }
+	gl_log("GL state: %.1f calls/frame issued, %.1f elided\n",
+		   (double)issued / frames, (double)elided / frames);
+	for (int k=0; k<GL_STATE_KINDS; k++) {
+		gl_log("  %-15s %10lu issued %10lu elided\n", kind_names[k], stats.issued[k], stats.elided[k]);
+	}
+}
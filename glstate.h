@@ -0,0 +1,60 @@
+#ifndef KESHI_GLSTATE
+#define KESHI_GLSTATE
+
+#include <GL/glew.h>
+
+#define GL_STATE_MAX_TEXTURE_UNITS 32
+// Indexed UBO/SSBO binding points tracked per target.
+#define GL_STATE_MAX_INDEXED 16
+
+// What the counters are kept per.
+#define GL_STATE_PROGRAM 0
+#define GL_STATE_VAO 1
+#define GL_STATE_BUFFER 2
+#define GL_STATE_INDEXED_BUFFER 3
+#define GL_STATE_ACTIVE_TEXTURE 4
+#define GL_STATE_TEXTURE 5
+#define GL_STATE_VIEWPORT 6
+#define GL_STATE_ENABLE 7
+#define GL_STATE_KINDS 8
+
+/*
+ * A shadow of the GL binding state.
+ * The gl_*() wrappers below skip the real call when it wouldn't change
+ * anything. The shadow is only right if every bind goes through them,
+ * so nothing else in the tree calls glBind*, glUseProgram,
+ * glActiveTexture, glViewport or glEnable directly. When an object is
+ * deleted GL unbinds it, and its name may come straight back from the
+ * next glGen*, so call the matching gl_forget_*() next to each delete.
+ * Targets and caps that aren't tracked are passed straight through.
+ * Everything starts out unknown, so the first call always happens.
+ */
+struct gl_state_stats {
+	unsigned long issued[GL_STATE_KINDS];
+	unsigned long elided[GL_STATE_KINDS];
+};
+
+void gl_use_program(GLuint program);
+void gl_bind_vao(GLuint vao);
+void gl_bind_buffer(GLenum target, GLuint buffer);
+void gl_bind_buffer_base(GLenum target, GLuint index, GLuint buffer);
+void gl_bind_buffer_range(GLenum target, GLuint index, GLuint buffer,
+						  GLintptr offset, GLsizeiptr size);
+// Takes GL_TEXTURE0 + i, like glActiveTexture.
+void gl_active_texture(GLenum unit);
+void gl_bind_texture(GLenum target, GLuint texture);
+void gl_viewport(GLint x, GLint y, GLsizei w, GLsizei h);
+void gl_enable(GLenum cap);
+void gl_disable(GLenum cap);
+
+void gl_forget_program(GLuint program);
+void gl_forget_vao(GLuint vao);
+void gl_forget_buffer(GLuint buffer);
+void gl_forget_texture(GLuint texture);
+// Back to unknown, e.g. after code that binds things behind our back.
+void reset_gl_state();
+
+gl_state_stats get_gl_state_stats();
+void log_gl_state_stats(unsigned long frames);
+
+#endif
@@ -0,0 +1,72 @@
+#include "gputimer.h"
+
+void init_gpu_timer(gpu_timer* timer) {
+	glGenQueries(GPU_TIMER_LATENCY, timer->time_queries);
+	glGenQueries(GPU_TIMER_LATENCY, timer->sample_queries);
+	for (int i=0; i<GPU_TIMER_LATENCY; i++) {
+		timer->pending[i] = false;
+	}
+	timer->next = 0;
+	reset_gpu_timer(timer);
+}
+
+static void collect(gpu_timer* timer, int i) {
+	GLuint64 ns = 0;
+	GLuint64 samples = 0;
+	glGetQueryObjectui64v(timer->time_queries[i], GL_QUERY_RESULT, &ns);
+	glGetQueryObjectui64v(timer->sample_queries[i], GL_QUERY_RESULT, &samples);
+	timer->pending[i] = false;
+	timer->frames++;
+	timer->total_ms += ns / 1000000.0;
+	timer->total_samples += samples;
+}
+
+void begin_gpu_timer(gpu_timer* timer) {
+	int i = timer->next;
+	// Out of slots; this one's GPU_TIMER_LATENCY frames old, so it's
+	// almost certainly done anyway.
+	if (timer->pending[i]) { collect(timer, i); }
+	glBeginQuery(GL_TIME_ELAPSED, timer->time_queries[i]);
+	glBeginQuery(GL_SAMPLES_PASSED, timer->sample_queries[i]);
+}
+
+void end_gpu_timer(gpu_timer* timer) {
+	glEndQuery(GL_SAMPLES_PASSED);
+	glEndQuery(GL_TIME_ELAPSED);
+	timer->pending[timer->next] = true;
+	timer->next = (timer->next + 1) % GPU_TIMER_LATENCY;
+
+	// Pick up whatever has finished without waiting on the rest.
+	for (int i=0; i<GPU_TIMER_LATENCY; i++) {
+		if (!timer->pending[i]) { continue; }
+		GLint ready = GL_FALSE;
+		glGetQueryObjectiv(timer->time_queries[i], GL_QUERY_RESULT_AVAILABLE, &ready);
+		if (ready) { collect(timer, i); }
+	}
+}
+
+void finish_gpu_timer(gpu_timer* timer) {
+	for (int i=0; i<GPU_TIMER_LATENCY; i++) {
+		if (timer->pending[i]) { collect(timer, i); }
+	}
+}
+
+void reset_gpu_timer(gpu_timer* timer) {
+	finish_gpu_timer(timer);
+	timer->frames = 0;
+	timer->total_ms = 0.0;
+	timer->total_samples = 0;
+}
+
+void destroy_gpu_timer(gpu_timer* timer) {
+	glDeleteQueries(GPU_TIMER_LATENCY, timer->time_queries);
+	glDeleteQueries(GPU_TIMER_LATENCY, timer->sample_queries);
+}
+
+double gpu_ms_per_frame(const gpu_timer* timer) {
+	return timer->frames ? timer->total_ms / timer->frames : 0.0;
+}
+
+double gpu_ns_per_sample(const gpu_timer* timer) {
+	return timer->total_samples ? timer->total_ms * 1000000.0 / timer->total_samples : 0.0;
+}
@@ -0,0 +1,37 @@
+#ifndef KESHI_GPUTIMER
+#define KESHI_GPUTIMER
+
+#include <GL/glew.h>
+
+// Frames of queries in flight, so reading results never stalls the GPU.
+#define GPU_TIMER_LATENCY 4
+
+/*
+ * GPU time and samples shaded for a span of draw calls, via
+ * GL_TIME_ELAPSED and GL_SAMPLES_PASSED queries. Results are collected
+ * a few frames late, whenever they're ready.
+ * Samples are pixels times the MSAA sample count, for what passes the
+ * depth test.
+ */
+struct gpu_timer {
+	GLuint time_queries[GPU_TIMER_LATENCY];
+	GLuint sample_queries[GPU_TIMER_LATENCY];
+	bool pending[GPU_TIMER_LATENCY];
+	int next;
+	unsigned long frames;
+	double total_ms;
+	unsigned long long total_samples;
+};
+
+void init_gpu_timer(gpu_timer* timer);
+void begin_gpu_timer(gpu_timer* timer);
+void end_gpu_timer(gpu_timer* timer);
+// Waits for everything in flight.
+void finish_gpu_timer(gpu_timer* timer);
+void reset_gpu_timer(gpu_timer* timer);
+void destroy_gpu_timer(gpu_timer* timer);
+
+double gpu_ms_per_frame(const gpu_timer* timer);
+double gpu_ns_per_sample(const gpu_timer* timer);
+
+#endif
@@ -0,0 +1,50 @@
+#include "instances.h"
+
+#include <float.h>
+
+#include "batch.h"
+#include "glresource.h"
+
+void init_instance_buffer(instance_buffer* instances) {
+	instances->transforms.clear();
+	instances->vbo = create_mutable_buffer(0, NULL, GL_STATIC_DRAW);
+	instances->dirty = true;
+	instances->bounds_min = v3(FLT_MAX, FLT_MAX, FLT_MAX);
+	instances->bounds_max = v3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	instances->max_scale = 0.0f;
+}
+
+void destroy_instance_buffer(instance_buffer* instances) {
+	detach_vertex_buffer(static_vertex_format(), instances->vbo);
+	delete_buffer(&instances->vbo);
+	instances->transforms.clear();
+}
+
+int add_instance(instance_buffer* instances, m4 model) {
+	instances->transforms.push_back(transpose(model));
+	instances->dirty = true;
+	for (int k=0; k<3; k++) {
+		float origin = model.m[k*4 + 3];
+		if (origin < instances->bounds_min.v[k]) { instances->bounds_min.v[k] = origin; }
+		if (origin > instances->bounds_max.v[k]) { instances->bounds_max.v[k] = origin; }
+		v3 axis(model.m[k], model.m[4 + k], model.m[8 + k]);
+		float scale = magnitude(axis);
+		if (scale > instances->max_scale) { instances->max_scale = scale; }
+	}
+	return instances->transforms.size() - 1;
+}
+
+void upload_instances(instance_buffer* instances) {
+	if (!instances->dirty || instances->transforms.empty()) { return; }
+	set_buffer_data(instances->vbo, sizeof(m4) * instances->transforms.size(),
+					&instances->transforms[0], GL_STATIC_DRAW);
+	instances->dirty = false;
+}
+
+void set_default_model_matrix() {
+	for (int col=0; col<4; col++) {
+		float c[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		c[col] = 1.0f;
+		glVertexAttrib4fv(INSTANCE_MATRIX_LOCATION + col, c);
+	}
+}
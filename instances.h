@@ -0,0 +1,42 @@
+#ifndef KESHI_INSTANCES
+#define KESHI_INSTANCES
+
+#include <GL/glew.h>
+
+#include <vector>
+
+#include "math3d.h"
+
+// 'M' in test.vert: a mat4 attribute takes four locations, a column each.
+// Stepped per instance from STATIC_INSTANCE_BINDING (batch.h).
+#define INSTANCE_MATRIX_LOCATION 4
+
+/*
+ * Per-instance model matrices, fed to the vertex shader as an instanced
+ * attribute (divisor 1), so N copies of a mesh are one
+ * glDrawArraysInstanced over one copy of its vertices. Attach 'vbo' at
+ * STATIC_INSTANCE_BINDING of the static_vertex format to draw with them.
+ * Matrices are stored transposed, i.e. column-major as GLSL reads them.
+ * Batches draw with a buffer holding just the identity there; VAOs
+ * without the attribute (the unbatched benchmark) get it from the
+ * generic attribute values set by set_default_model_matrix().
+ */
+struct instance_buffer {
+	std::vector<m4> transforms;
+	GLuint vbo;
+	bool dirty;
+	// Box around the instances' origins and their biggest scale, kept
+	// up to date by add_instance(), so nothing has to walk them all.
+	v3 bounds_min, bounds_max;
+	float max_scale;
+};
+
+void init_instance_buffer(instance_buffer* instances);
+void destroy_instance_buffer(instance_buffer* instances);
+int add_instance(instance_buffer* instances, m4 model);
+// Sends the transforms if anything changed.
+void upload_instances(instance_buffer* instances);
+// Once, after context creation; generic attributes aren't VAO state.
+void set_default_model_matrix();
+
+#endif
@@ -0,0 +1,153 @@
+#include "lights.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "util.h"
+
+static_assert(sizeof(gpu_light) == 64 && offsetof(gpu_light, Ls) == 16 &&
+			  offsetof(gpu_light, Ld) == 32 && offsetof(gpu_light, La) == 48,
+			  "gpu_light must match struct light in lights.glsl");
+
+void init_light_system(light_system* lights) {
+	lights->pos_W.clear();
+	lights->prev_pos_W.clear();
+	lights->draw_pos_W.clear();
+	lights->velocity.clear();
+	lights->bounds_min.clear();
+	lights->bounds_max.clear();
+	lights->radius.clear();
+	lights->gpu.clear();
+	lights->indices.clear();
+	lights->gpu_alloc.ptr = lights->index_alloc.ptr = NULL;
+}
+
+void destroy_light_system(light_system* lights) {
+	lights->pos_W.clear();
+	lights->prev_pos_W.clear();
+	lights->draw_pos_W.clear();
+	lights->gpu.clear();
+	lights->indices.clear();
+}
+
+int add_light(light_system* lights, v3 pos_W, float radius, v3 Ls, v3 Ld, v3 La) {
+	lights->pos_W.push_back(pos_W);
+	lights->prev_pos_W.push_back(pos_W);
+	lights->draw_pos_W.push_back(pos_W);
+	lights->velocity.push_back(v3(0.0f, 0.0f, 0.0f));
+	lights->bounds_min.push_back(pos_W);
+	lights->bounds_max.push_back(pos_W);
+	lights->radius.push_back(radius);
+
+	gpu_light g;
+	g.pos_E = v4(pos_W, radius);
+	g.Ls = v4(Ls, 0.0f);
+	g.Ld = v4(Ld, 0.0f);
+	g.La = v4(La, 0.0f);
+	lights->gpu.push_back(g);
+	return lights->pos_W.size() - 1;
+}
+
+void animate_light(light_system* lights, int light, v3 velocity, v3 bounds_min, v3 bounds_max) {
+	lights->velocity[light] = velocity;
+	lights->bounds_min[light] = bounds_min;
+	lights->bounds_max[light] = bounds_max;
+}
+
+void update_lights(light_system* lights, float step_sec) {
+	int n = lights->pos_W.size();
+	lights->prev_pos_W = lights->pos_W;
+	v3* pos = n ? &lights->pos_W[0] : NULL;
+	v3* vel = n ? &lights->velocity[0] : NULL;
+	const v3* lo = n ? &lights->bounds_min[0] : NULL;
+	const v3* hi = n ? &lights->bounds_max[0] : NULL;
+	for (int i=0; i<n; i++) {
+		for (int k=0; k<3; k++) {
+			float p = pos[i].v[k] + vel[i].v[k] * step_sec;
+			// Bounce off the box.
+			if (p >= hi[i].v[k]) { p = hi[i].v[k]; vel[i].v[k] = -fabsf(vel[i].v[k]); }
+			else if (p <= lo[i].v[k]) { p = lo[i].v[k]; vel[i].v[k] = fabsf(vel[i].v[k]); }
+			pos[i].v[k] = p;
+		}
+	}
+}
+
+void interpolate_lights(light_system* lights, float alpha) {
+	int n = lights->pos_W.size();
+	for (int i=0; i<n; i++) {
+		lights->draw_pos_W[i] = lerp(lights->prev_pos_W[i], lights->pos_W[i], alpha);
+	}
+}
+
+void reset_light_lists(light_system* lights) {
+	lights->indices.clear();
+}
+
+light_list cull_lights(light_system* lights, v3 center_W, float radius) {
+	return cull_lights_into(lights, center_W, radius, &lights->indices);
+}
+
+light_list cull_lights_into(const light_system* lights, v3 center_W, float radius,
+							std::vector<GLuint>* indices) {
+	light_list list;
+	list.offset = indices->size();
+	int n = lights->pos_W.size();
+	for (int i=0; i<n; i++) {
+		float dx = lights->draw_pos_W[i].v[0] - center_W.v[0];
+		float dy = lights->draw_pos_W[i].v[1] - center_W.v[1];
+		float dz = lights->draw_pos_W[i].v[2] - center_W.v[2];
+		float reach = lights->radius[i] + radius;
+		if (dx*dx + dy*dy + dz*dz < reach*reach) {
+			indices->push_back(i);
+		}
+	}
+	list.count = indices->size() - list.offset;
+	return list;
+}
+
+void upload_lights(light_system* lights, uniform_ring* ring, m4* view) {
+	int n = lights->pos_W.size();
+	for (int i=0; i<n; i++) {
+		v4 pos(lights->draw_pos_W[i], 1.0f);
+		if (view) { pos = *view * pos; }
+		pos.v[3] = lights->radius[i];
+		lights->gpu[i].pos_E = pos;
+	}
+
+	// Into this frame's region of the ring; one copy each, whatever the
+	// light count. Bound ranges can't be empty, hence the max().
+	int num_indices = lights->indices.size();
+	lights->gpu_alloc = alloc_uniforms(ring, sizeof(gpu_light) * std::max(n, 1));
+	lights->index_alloc = alloc_uniforms(ring, sizeof(GLuint) * std::max(num_indices, 1));
+	if (lights->gpu_alloc.ptr && n) {
+		memcpy(lights->gpu_alloc.ptr, &lights->gpu[0], sizeof(gpu_light) * n);
+	}
+	if (lights->index_alloc.ptr && num_indices) {
+		memcpy(lights->index_alloc.ptr, &lights->indices[0], sizeof(GLuint) * num_indices);
+	}
+}
+
+void bind_lights(const light_system* lights, const uniform_ring* ring) {
+	bind_uniforms(ring, GL_SHADER_STORAGE_BUFFER, LIGHT_SSBO_BINDING, lights->gpu_alloc);
+	bind_uniforms(ring, GL_SHADER_STORAGE_BUFFER, LIGHT_INDEX_SSBO_BINDING, lights->index_alloc);
+}
+
+void use_light_list(light_list list) {
+	glUniform2i(LIGHT_LIST_LOCATION, list.offset, list.count);
+}
+
+void record_light_list(command_list* commands, light_list list) {
+	cmd_uniform_2i(commands, LIGHT_LIST_LOCATION, list.offset, list.count);
+}
+
+void record_light_indices(command_list* commands, const std::vector<GLuint>& indices) {
+	// Copied into the ring at replay; as in upload_lights(), never empty.
+	int size = sizeof(GLuint) * std::max((int)indices.size(), 1);
+	void* data = cmd_uniforms(commands, GL_SHADER_STORAGE_BUFFER, LIGHT_INDEX_SSBO_BINDING, size);
+	if (!indices.empty()) {
+		memcpy(data, &indices[0], sizeof(GLuint) * indices.size());
+	}
+}
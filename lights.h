@@ -0,0 +1,93 @@
+#ifndef KESHI_LIGHTS
+#define KESHI_LIGHTS
+
+#include <GL/glew.h>
+
+#include <vector>
+
+#include "commands.h"
+#include "math3d.h"
+#include "uniformring.h"
+
+// Shader storage bindings and the per-draw list uniform (see lights.glsl).
+#define LIGHT_SSBO_BINDING 3
+#define LIGHT_INDEX_SSBO_BINDING 4
+#define LIGHT_LIST_LOCATION 1
+
+/*
+ * One entry of the light SSBO (std430, 64 bytes).
+ * pos_E.xyz is the eye space position and pos_E.w the radius past which
+ * the light contributes nothing.
+ */
+struct gpu_light {
+	v4 pos_E;
+	v4 Ls;
+	v4 Ld;
+	v4 La;
+};
+
+// A run of light_indices for one draw.
+struct light_list {
+	int offset;
+	int count;
+};
+
+/*
+ * Any number of point lights.
+ * CPU state is kept per field, so the batched update_lights() only
+ * streams through the positions and velocities. Each light bounces
+ * between two corners of a box at a constant velocity; a zero velocity
+ * holds it still.
+ * update_lights() is a fixed simulation step (simclock.h); lights are
+ * culled and drawn where interpolate_lights() puts them between the
+ * last two steps.
+ * Each frame: update_lights per step, interpolate_lights, cull_lights
+ * per draw, upload_lights.
+ * Recording threads cull into their own index arrays instead, with
+ * cull_lights_into(), and put them in their command list with
+ * record_light_indices(); culling only reads the light system.
+ */
+struct light_system {
+	std::vector<v3> pos_W;
+	// Where the last step started from, and where they're drawn.
+	std::vector<v3> prev_pos_W;
+	std::vector<v3> draw_pos_W;
+	std::vector<v3> velocity;
+	std::vector<v3> bounds_min;
+	std::vector<v3> bounds_max;
+	std::vector<float> radius;
+	// What the shaders see, rebuilt by upload_lights().
+	std::vector<gpu_light> gpu;
+	// Per-draw light lists, rebuilt every frame.
+	std::vector<GLuint> indices;
+	// Where this frame's copies went in the uniform ring.
+	uniform_alloc gpu_alloc;
+	uniform_alloc index_alloc;
+};
+
+void init_light_system(light_system* lights);
+void destroy_light_system(light_system* lights);
+int add_light(light_system* lights, v3 pos_W, float radius, v3 Ls, v3 Ld, v3 La);
+void animate_light(light_system* lights, int light, v3 velocity, v3 bounds_min, v3 bounds_max);
+
+void update_lights(light_system* lights, float step_sec);
+// 0 draws them where the last step started, 1 where it ended.
+void interpolate_lights(light_system* lights, float alpha);
+// Forgets last frame's lists.
+void reset_light_lists(light_system* lights);
+// Lights whose radius reaches a bounding sphere.
+light_list cull_lights(light_system* lights, v3 center_W, float radius);
+// Same, appended to 'indices' rather than the shared lists.
+light_list cull_lights_into(const light_system* lights, v3 center_W, float radius,
+							std::vector<GLuint>* indices);
+// Positions go up in eye space if 'view' is given, world space if NULL.
+void upload_lights(light_system* lights, uniform_ring* ring, m4* view);
+void bind_lights(const light_system* lights, const uniform_ring* ring);
+// Before a draw; tells the shader which lights to loop over.
+void use_light_list(light_list list);
+void record_light_list(command_list* commands, light_list list);
+// Binds 'indices' in place of the shared lists for the draws recorded
+// after it; their light_lists index into it.
+void record_light_indices(command_list* commands, const std::vector<GLuint>& indices);
+
+#endif
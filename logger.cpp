@@ -0,0 +1,557 @@
+#include "logger.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <thread>
+
+static_assert(sizeof(log_slot) == LOG_SLOT_SIZE, "log_slot should fill its slot exactly");
+static_assert((LOG_RING_SLOTS & (LOG_RING_SLOTS - 1)) == 0, "LOG_RING_SLOTS must be a power of two");
+
+/*
+ * The ring (Vyukov style): slot i is free for the producer at position
+ * p when seq == p, readable by the consumer when seq == p + 1, and
+ * handed back for the next lap by setting seq = p + LOG_RING_SLOTS.
+ */
+static log_slot ring[LOG_RING_SLOTS];
+static std::atomic<uint64_t> ring_head(0);
+static uint64_t ring_tail = 0;
+
+static int log_fd = -1;
+static std::thread writer;
+static std::atomic<bool> running(false);
+// Held by whoever is draining: the writer thread or a crash handler.
+static std::atomic_flag draining = ATOMIC_FLAG_INIT;
+static std::atomic<uint64_t> written(0);
+
+int gl_log_mode = LOG_MODE_DEFERRED;
+static uint64_t log_start_ns = 0;
+
+static std::atomic<unsigned long> messages(0);
+static std::atomic<unsigned long> dropped(0);
+static unsigned long writes = 0;
+static unsigned long bytes = 0;
+
+static log_slot* slot_at(uint64_t pos) {
+	return &ring[pos & (LOG_RING_SLOTS - 1)];
+}
+
+static void reset_writer();
+
+// Also on a restart after shutdown_gl_log(): positions go back to 0
+// along with the slots, or every push would miss.
+static void init_ring() {
+	for (uint64_t i=0; i<LOG_RING_SLOTS; i++) {
+		ring[i].seq.store(i, std::memory_order_relaxed);
+	}
+	ring_head.store(0, std::memory_order_relaxed);
+	ring_tail = 0;
+	written.store(0, std::memory_order_relaxed);
+	reset_writer();
+}
+
+static bool ring_push(const char* text, int len, uint16_t flags) {
+	int n = (len + LOG_SLOT_TEXT - 1) / LOG_SLOT_TEXT;
+	if (n == 0) { return true; }
+
+	uint64_t pos = ring_head.load(std::memory_order_relaxed);
+	for (;;) {
+		bool free = true;
+		for (int i=0; i<n && free; i++) {
+			free = slot_at(pos + i)->seq.load(std::memory_order_acquire) == pos + i;
+		}
+		if (free) {
+			if (ring_head.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed)) { break; }
+			continue;
+		}
+		// Either the ring is full or another producer got here first.
+		uint64_t now = ring_head.load(std::memory_order_relaxed);
+		if (now == pos) {
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		pos = now;
+	}
+
+	for (int i=0; i<n; i++) {
+		log_slot* s = slot_at(pos + i);
+		int chunk = (len < LOG_SLOT_TEXT) ? len : LOG_SLOT_TEXT;
+		memcpy(s->text, text, chunk);
+		s->len = chunk;
+		s->flags = (i == 0) ? flags : 0;
+		text += chunk;
+		len -= chunk;
+		s->seq.store(pos + i + 1, std::memory_order_release);
+	}
+	messages.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+static void write_all(const char* buf, size_t len) {
+	while (len > 0) {
+		ssize_t w = write(log_fd, buf, len);
+		if (w <= 0) { return; }
+		buf += w;
+		len -= w;
+	}
+	writes++;
+}
+
+static uint64_t now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Formatting a deferred record: walk the format string and hand each
+ * conversion to snprintf with the matching argument, widened to what
+ * the record stored (64-bit integers, doubles).
+ */
+struct record_reader {
+	const char* p;
+	const char* end;
+};
+
+// Integers come back cut to the size they were passed as: sign
+// extended for %d, zero extended for %u and the rest.
+static bool read_arg(record_reader* r, char* tag, uint64_t* bits, const char** str, uint32_t* len,
+					 int* size = NULL) {
+	if (r->p >= r->end) { return false; }
+	*tag = *r->p & 0xf;
+	if (size) { *size = (*r->p >> 4) & 0xf; }
+	r->p++;
+	if (*tag == LOG_ARG_STRING) {
+		memcpy(len, r->p, sizeof(*len));
+		*str = r->p + sizeof(*len);
+		r->p += sizeof(*len) + *len;
+	}
+	else {
+		memcpy(bits, r->p, sizeof(*bits));
+		r->p += sizeof(*bits);
+	}
+	return true;
+}
+
+static int format_record(const char* record, int record_len, char* out, int out_len) {
+	log_record_header h;
+	memcpy(&h, record, sizeof(h));
+	record_reader r = { record + sizeof(h), record + record_len };
+	int used = 0;
+	const char* f = h.fmt;
+	while (*f && used < out_len - 1) {
+		if (*f != '%') { out[used++] = *f++; continue; }
+		if (f[1] == '%') { out[used++] = '%'; f += 2; continue; }
+
+		// %[flags][width][.precision][length]conversion
+		char spec[64];
+		int n = 0;
+		spec[n++] = *f++;
+		while (*f && strchr("-+ #0", *f) && n < 20) { spec[n++] = *f++; }
+		// Width, then precision; a '*' takes the next argument. A negative
+		// '*' width means left justified, which "%-5d" says anyway, and a
+		// negative precision means none.
+		for (int part=0; part<2; part++) {
+			if (part == 1) {
+				if (*f != '.') { break; }
+				spec[n++] = *f++;
+			}
+			if (*f == '*') {
+				f++;
+				char star_tag = 0;
+				uint64_t star = 0;
+				const char* unused_str = NULL;
+				uint32_t unused_len = 0;
+				read_arg(&r, &star_tag, &star, &unused_str, &unused_len);
+				int value = (int)(int64_t)star;
+				if (part == 1 && value < 0) { n--; continue; }
+				n += snprintf(spec + n, 16, "%d", value);
+			}
+			else {
+				while (*f >= '0' && *f <= '9' && n < 50) { spec[n++] = *f++; }
+			}
+		}
+		int h = 0;
+		while (*f && strchr("hlLqjzt", *f)) { h += (*f++ == 'h'); }
+		char conv = *f ? *f++ : 'd';
+
+		char tag = 0;
+		uint64_t bits = 0;
+		const char* str = NULL;
+		uint32_t len = 0;
+		int size = 0;
+		if (!read_arg(&r, &tag, &bits, &str, &len, &size)) {
+			used += snprintf(out + used, out_len - used, "<missing>");
+			continue;
+		}
+		// Small types were promoted to int on the way in; %h and %hh cut
+		// them back down.
+		if (size > 0 && size < (int)sizeof(int)) { size = sizeof(int); }
+		if (h) { size = (h == 1) ? sizeof(short) : sizeof(char); }
+		if ((tag == LOG_ARG_INT || tag == LOG_ARG_UINT) && size > 0 && size < 8 && strchr("diouxX", conv)) {
+			int shift = 64 - size * 8;
+			bits = (conv == 'd' || conv == 'i') ?
+				(uint64_t)((int64_t)(bits << shift) >> shift) : (bits << shift) >> shift;
+		}
+		int64_t i = (int64_t)bits;
+		double d = 0.0;
+		if (tag == LOG_ARG_DOUBLE) { memcpy(&d, &bits, sizeof(d)); }
+		else { d = (tag == LOG_ARG_INT) ? (double)i : (double)bits; }
+
+		int wrote = 0;
+		switch (conv) {
+		case 's': {
+			// Strings aren't terminated in the record, so the length goes
+			// in as the precision (or the format's, if that's shorter).
+			spec[n] = '\0';
+			char* dot = strchr(spec, '.');
+			if (dot) {
+				uint32_t precision = atoi(dot + 1);
+				if (precision < len) { len = precision; }
+				n = dot - spec;
+			}
+			spec[n++] = '.'; spec[n++] = '*'; spec[n++] = 's'; spec[n] = '\0';
+			wrote = (tag == LOG_ARG_STRING) ?
+				snprintf(out + used, out_len - used, spec, (int)len, str) :
+				snprintf(out + used, out_len - used, "<not a string>");
+			break;
+		}
+		case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+			spec[n++] = conv; spec[n] = '\0';
+			wrote = snprintf(out + used, out_len - used, spec, d);
+			break;
+		case 'p':
+			spec[n++] = 'p'; spec[n] = '\0';
+			wrote = snprintf(out + used, out_len - used, spec, (void*)(uintptr_t)bits);
+			break;
+		case 'c':
+			spec[n++] = 'c'; spec[n] = '\0';
+			wrote = snprintf(out + used, out_len - used, spec, (int)i);
+			break;
+		default:
+			spec[n++] = 'l'; spec[n++] = 'l'; spec[n++] = conv; spec[n] = '\0';
+			if (tag == LOG_ARG_DOUBLE) { i = (int64_t)d; bits = (uint64_t)i; }
+			if (conv == 'd' || conv == 'i') {
+				wrote = snprintf(out + used, out_len - used, spec, (long long)i);
+			}
+			else {
+				wrote = snprintf(out + used, out_len - used, spec, (unsigned long long)bits);
+			}
+			break;
+		}
+		if (wrote > 0) { used += wrote; }
+		if (used > out_len - 1) { used = out_len - 1; }
+	}
+	out[used] = '\0';
+	return used;
+}
+
+/*
+ * The writer's side. Caller holds 'draining'.
+ * Plain text goes straight out; records are reassembled from their
+ * slots, then formatted. The crash handler calls this too, but only
+ * once it holds 'draining', so it never runs alongside the writer.
+ * That's still best effort: timestamps, records and the dropped note
+ * all go through snprintf, which isn't async-signal-safe.
+ */
+static char batch[64 * 1024];
+static size_t batch_used = 0;
+static bool at_line_start = true;
+// A record being put back together from its slots.
+static char partial[LOG_MAX_MESSAGE];
+static int partial_len = 0;
+static int partial_size = 0;
+// Drops already noted in the file.
+static unsigned long reported = 0;
+
+static void reset_writer() {
+	batch_used = 0;
+	at_line_start = true;
+	partial_len = 0;
+	partial_size = 0;
+	reported = dropped.load(std::memory_order_relaxed);
+}
+
+static void batch_append(const char* text, size_t len) {
+	if (batch_used + len > sizeof(batch)) {
+		write_all(batch, batch_used);
+		batch_used = 0;
+	}
+	memcpy(batch + batch_used, text, len);
+	batch_used += len;
+	bytes += len;
+	if (len) { at_line_start = text[len-1] == '\n'; }
+}
+
+static void emit_record(const char* record, int len) {
+	char text[LOG_MAX_MESSAGE + 32];
+	int used = 0;
+	if (at_line_start) {
+		log_record_header h;
+		memcpy(&h, record, sizeof(h));
+		used = snprintf(text, sizeof(text), "[%11.6f] ", (h.ns - log_start_ns) / 1e9);
+	}
+	used += format_record(record, len, text + used, sizeof(text) - used);
+	batch_append(text, used);
+}
+
+static bool drain() {
+	bool any = false;
+	for (;;) {
+		log_slot* s = slot_at(ring_tail);
+		if (s->seq.load(std::memory_order_acquire) != ring_tail + 1) { break; }
+		if (s->flags & LOG_SLOT_RECORD) {
+			memcpy(&partial_size, s->text, sizeof(uint32_t));
+			partial_len = 0;
+		}
+		if (partial_size) {
+			memcpy(partial + partial_len, s->text, s->len);
+			partial_len += s->len;
+			if (partial_len >= partial_size) {
+				emit_record(partial, partial_size);
+				partial_size = 0;
+			}
+		}
+		else {
+			batch_append(s->text, s->len);
+		}
+		s->seq.store(ring_tail + LOG_RING_SLOTS, std::memory_order_release);
+		ring_tail++;
+		any = true;
+	}
+
+	unsigned long lost = dropped.load(std::memory_order_relaxed);
+	if (lost != reported) {
+		char note[96];
+		int len = snprintf(note, sizeof(note), "[log] ring full, dropped %lu message(s)\n", lost - reported);
+		batch_append(note, len);
+		reported = lost;
+	}
+	if (batch_used) {
+		write_all(batch, batch_used);
+		batch_used = 0;
+	}
+	written.store(ring_tail, std::memory_order_release);
+	return any;
+}
+
+static void writer_loop() {
+	for (;;) {
+		bool stopping = !running.load(std::memory_order_acquire);
+		bool any = false;
+		if (!draining.test_and_set(std::memory_order_acquire)) {
+			any = drain();
+			draining.clear(std::memory_order_release);
+		}
+		if (stopping) { break; }
+		if (!any) { std::this_thread::sleep_for(std::chrono::microseconds(LOG_IDLE_US)); }
+	}
+}
+
+// Installed with SA_RESETHAND, so the raise() at the end gets the
+// default action.
+static void crash_handler(int sig) {
+	// Give the writer up to 100ms to finish its batch. If it doesn't (or
+	// this is the writer, faulting mid-drain), leave the ring alone.
+	bool owned = false;
+	for (int i=0; i<1000; i++) {
+		if (!draining.test_and_set(std::memory_order_acquire)) {
+			owned = true;
+			break;
+		}
+		struct timespec wait = { 0, 100000 };
+		nanosleep(&wait, NULL);
+	}
+	if (log_fd >= 0) {
+		const char* msg = owned ? "[log] fatal signal, flushed log\n" :
+			"[log] fatal signal, writer busy, log not flushed\n";
+		if (owned) { drain(); }
+		write_all(msg, strlen(msg));
+		fsync(log_fd);
+	}
+	raise(sig);
+}
+
+/*
+ * Synchronous fallback, for before restart_gl_log() or in tools.
+ */
+static int append_sync(const char* text, int len) {
+	FILE* file = fopen(GL_LOG_FILE, "a");
+	if (!file) {
+		fprintf(stderr, "Error: couldn't open log file for appending: %s\n", GL_LOG_FILE);
+		return 1;
+	}
+	fwrite(text, 1, len, file);
+	fclose(file);
+	return 0;
+}
+
+static int log_text(const char* text, int len) {
+	if (!running.load(std::memory_order_relaxed)) {
+		return append_sync(text, len);
+	}
+	return ring_push(text, len, 0) ? 0 : 1;
+}
+
+int restart_gl_log() {
+	if (!running.load()) {
+		log_fd = open(GL_LOG_FILE, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+		if (log_fd < 0) {
+			fprintf(stderr, "Error: couldn't open log file for writing: %s\n", GL_LOG_FILE);
+			return 1;
+		}
+		init_ring();
+		log_start_ns = now_ns();
+		running.store(true);
+		writer = std::thread(writer_loop);
+
+		static bool registered = false;
+		if (!registered) {
+			atexit(shutdown_gl_log);
+			struct sigaction action;
+			memset(&action, 0, sizeof(action));
+			action.sa_handler = crash_handler;
+			action.sa_flags = SA_RESETHAND;
+			sigemptyset(&action.sa_mask);
+			int fatal[] = { SIGSEGV, SIGABRT, SIGBUS, SIGFPE, SIGILL };
+			for (unsigned int i=0; i<sizeof(fatal)/sizeof(fatal[0]); i++) {
+				sigaction(fatal[i], &action, NULL);
+			}
+			registered = true;
+		}
+	}
+
+	time_t now = time(NULL);
+	char* datetime = ctime(&now);
+	gl_log("----------\nInit log. Local time %s\n", datetime);
+	return 0;
+}
+
+int gl_log_text(const char* msg, ...) {
+	char text[LOG_MAX_MESSAGE];
+	va_list argptr;
+	va_start(argptr, msg);
+	int len = vsnprintf(text, sizeof(text), msg, argptr);
+	va_end(argptr);
+	if (len < 0) { return 1; }
+	if (len >= (int)sizeof(text)) { len = sizeof(text) - 1; }
+	return log_text(text, len);
+}
+
+int gl_log_error(const char* msg, ...) {
+	char text[LOG_MAX_MESSAGE];
+	va_list argptr;
+	va_start(argptr, msg);
+	int len = vsnprintf(text, sizeof(text), msg, argptr);
+	va_end(argptr);
+	if (len < 0) { return 1; }
+	if (len >= (int)sizeof(text)) { len = sizeof(text) - 1; }
+	// Errors are rare and worth seeing right away.
+	fwrite(text, 1, len, stderr);
+	return log_text(text, len);
+}
+
+int push_log_record(const char* fmt, char* record, log_record_writer* w) {
+	log_record_header h;
+	h.size = w->p - record;
+	h.num_args = w->num_args;
+	h.fmt = fmt;
+	h.ns = now_ns();
+	memcpy(record, &h, sizeof(h));
+	if (!running.load(std::memory_order_relaxed)) {
+		char text[LOG_MAX_MESSAGE];
+		int len = format_record(record, h.size, text, sizeof(text));
+		return append_sync(text, len);
+	}
+	return ring_push(record, h.size, LOG_SLOT_RECORD) ? 0 : 1;
+}
+
+void flush_gl_log() {
+	if (!running.load()) { return; }
+	uint64_t target = ring_head.load(std::memory_order_acquire);
+	while (written.load(std::memory_order_acquire) < target) {
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
+}
+
+void shutdown_gl_log() {
+	if (!running.exchange(false)) { return; }
+	// The writer does one last drain on its way out.
+	writer.join();
+	close(log_fd);
+	log_fd = -1;
+}
+
+log_stats gl_log_stats() {
+	log_stats stats;
+	stats.messages = messages.load();
+	stats.dropped = dropped.load();
+	stats.writes = writes;
+	stats.bytes = bytes;
+	return stats;
+}
+
+/*
+ * Levels and categories.
+ */
+uint8_t log_levels[LOG_NUM_CATEGORIES] = {
+	LOG_DEFAULT_LEVEL, LOG_DEFAULT_LEVEL, LOG_DEFAULT_LEVEL, LOG_DEFAULT_LEVEL,
+	LOG_DEFAULT_LEVEL, LOG_DEFAULT_LEVEL, LOG_DEFAULT_LEVEL, LOG_DEFAULT_LEVEL,
+};
+static_assert(LOG_NUM_CATEGORIES == 8, "add the new category to log_levels and category_names");
+
+static const char* category_names[LOG_NUM_CATEGORIES] = {
+	"general", "gl", "shader", "texture", "mesh", "camera", "input", "lights",
+};
+static const char* level_names[] = { "trace", "debug", "info", "warn", "error", "off" };
+
+const char* log_category_name(int category) {
+	if (category < 0 || category >= LOG_NUM_CATEGORIES) { return "?"; }
+	return category_names[category];
+}
+
+void set_log_level(int category, int level) {
+	if (category < 0 || category >= LOG_NUM_CATEGORIES) { return; }
+	if (level < LOG_LEVEL_TRACE) { level = LOG_LEVEL_TRACE; }
+	if (level > LOG_LEVEL_OFF) { level = LOG_LEVEL_OFF; }
+	log_levels[category] = level;
+}
+
+static int find_name(const char** names, int count, const char* name, int len) {
+	for (int i=0; i<count; i++) {
+		if ((int)strlen(names[i]) == len && strncmp(names[i], name, len) == 0) { return i; }
+	}
+	return -1;
+}
+
+int set_log_levels(const char* spec) {
+	int failed = 0;
+	const char* p = spec;
+	while (*p) {
+		const char* end = strchr(p, ',');
+		if (!end) { end = p + strlen(p); }
+		const char* eq = (const char*)memchr(p, '=', end - p);
+		const char* level_str = eq ? eq + 1 : p;
+		int level = find_name(level_names, LOG_LEVEL_OFF + 1, level_str, end - level_str);
+		int category = eq ? find_name(category_names, LOG_NUM_CATEGORIES, p, eq - p) : -1;
+		if (level < 0 || (eq && category < 0)) {
+			gl_log_error("ERROR: bad log level '%.*s'\n", (int)(end - p), p);
+			failed++;
+		}
+		else if (eq) {
+			set_log_level(category, level);
+		}
+		else {
+			for (int c=0; c<LOG_NUM_CATEGORIES; c++) { set_log_level(c, level); }
+		}
+		p = *end ? end + 1 : end;
+	}
+	return failed ? 1 : 0;
+}
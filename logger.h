@@ -0,0 +1,255 @@
+#ifndef KESHI_LOGGER
+#define KESHI_LOGGER
+
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <type_traits>
+
+#define GL_LOG_FILE "log/gl.log"
+
+// Ring geometry; slots are a cache line pair, the count a power of two.
+#define LOG_RING_SLOTS 8192
+#define LOG_SLOT_SIZE 128
+#define LOG_SLOT_TEXT (LOG_SLOT_SIZE - 12)
+// Longest single message; longer ones are cut here.
+#define LOG_MAX_MESSAGE 4096
+// How long the writer thread naps when there's nothing to write.
+#define LOG_IDLE_US 2000
+
+#define LOG_MODE_TEXT 0
+#define LOG_MODE_DEFERRED 1
+
+// Severity levels, lowest first.
+#define LOG_LEVEL_TRACE 0
+#define LOG_LEVEL_DEBUG 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_WARN 3
+#define LOG_LEVEL_ERROR 4
+#define LOG_LEVEL_OFF 5
+
+// Anything below this is compiled out; override with -DLOG_MIN_LEVEL=...
+#ifndef LOG_MIN_LEVEL
+#ifdef NDEBUG
+#define LOG_MIN_LEVEL LOG_LEVEL_INFO
+#else
+#define LOG_MIN_LEVEL LOG_LEVEL_TRACE
+#endif
+#endif
+
+// Categories, each with its own runtime level (see log_levels).
+#define LOG_GENERAL 0
+#define LOG_GL 1
+#define LOG_SHADER 2
+#define LOG_TEXTURE 3
+#define LOG_MESH 4
+#define LOG_CAMERA 5
+#define LOG_INPUT 6
+#define LOG_LIGHTS 7
+#define LOG_NUM_CATEGORIES 8
+// What every category starts at.
+#define LOG_DEFAULT_LEVEL LOG_LEVEL_INFO
+
+// Argument tags in a deferred record.
+#define LOG_ARG_INT 1
+#define LOG_ARG_UINT 2
+#define LOG_ARG_DOUBLE 3
+#define LOG_ARG_STRING 4
+#define LOG_ARG_PTR 5
+
+/*
+ * Asynchronous logging.
+ * gl_log() formats into a lock-free multi-producer ring; a background
+ * thread drains it in batches to one persistent file descriptor.
+ * A message takes as many consecutive slots as it needs, claimed with
+ * one CAS, so messages from different threads never interleave.
+ * If the ring is full the message is dropped and counted, and the writer
+ * notes how many went missing, so a burst costs memory up to the ring
+ * size and no more. The ring is drained at exit and, best effort, from
+ * the handlers for fatal signals, so the last lines before a crash
+ * usually still land.
+ * Before restart_gl_log() starts it, logging writes synchronously.
+ */
+struct log_slot {
+	std::atomic<uint64_t> seq;
+	uint16_t len;
+	// LOG_SLOT_RECORD on the first slot of a deferred record.
+	uint16_t flags;
+	char text[LOG_SLOT_TEXT];
+};
+#define LOG_SLOT_RECORD 1
+
+/*
+ * Deferred formatting.
+ * In LOG_MODE_DEFERRED (the default), gl_log() doesn't format at all:
+ * it stores the format string pointer, a timestamp and the raw argument
+ * bytes as a binary record in the ring, and the writer thread does the
+ * printf-style formatting. Format strings must outlive the call (i.e.
+ * be literals, as they all are); %s arguments are copied.
+ * Deferred lines in the file start with the seconds since
+ * restart_gl_log(), taken when gl_log() was called.
+ */
+struct log_record_header {
+	uint32_t size;
+	uint32_t num_args;
+	const char* fmt;
+	uint64_t ns;
+};
+
+struct log_record_writer {
+	char* p;
+	char* end;
+	uint32_t num_args;
+};
+
+extern int gl_log_mode;
+
+struct log_stats {
+	unsigned long messages;
+	unsigned long dropped;
+	unsigned long writes;
+	unsigned long bytes;
+};
+
+int restart_gl_log();
+// Formats on the calling thread, whatever the mode.
+int gl_log_text(const char* msg, ...);
+int gl_log_error(const char* msg, ...);
+// Stamps and queues a record built by gl_log().
+int push_log_record(const char* fmt, char* record, log_record_writer* w);
+// Blocks until everything logged so far is in the file.
+void flush_gl_log();
+// Stops the writer thread after a final flush; registered with atexit.
+void shutdown_gl_log();
+log_stats gl_log_stats();
+
+/*
+ * Levels and categories.
+ * log_debug(LOG_MESH, "...", ...) and friends log only if the level is
+ * at least LOG_MIN_LEVEL, decided by the preprocessor, and at least
+ * log_levels[category], decided by one compare at runtime. Arguments
+ * aren't evaluated when the call is filtered out either way.
+ */
+extern uint8_t log_levels[LOG_NUM_CATEGORIES];
+
+void set_log_level(int category, int level);
+// "debug" sets every category, "mesh=debug,camera=trace" just those.
+int set_log_levels(const char* spec);
+const char* log_category_name(int category);
+
+/*
+ * Argument encoding: a tag byte, then the value, unaligned. Integers
+ * are widened to 64 bits with their original size in the tag's high
+ * nibble, so %x of a negative int comes out as 32 bits, as printf does.
+ */
+inline void log_encode_raw(log_record_writer* w, char tag, const void* value, int len) {
+	if (w->p + 1 + len > w->end) { return; }
+	*w->p++ = tag;
+	memcpy(w->p, value, len);
+	w->p += len;
+	w->num_args++;
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value>::type
+log_encode(log_record_writer* w, T value) {
+	char size = sizeof(T) << 4;
+	if (std::is_signed<T>::value) {
+		int64_t v = value;
+		log_encode_raw(w, LOG_ARG_INT | size, &v, sizeof(v));
+	}
+	else {
+		uint64_t v = value;
+		log_encode_raw(w, LOG_ARG_UINT | size, &v, sizeof(v));
+	}
+}
+
+inline void log_encode(log_record_writer* w, double value) {
+	log_encode_raw(w, LOG_ARG_DOUBLE, &value, sizeof(value));
+}
+
+inline void log_encode(log_record_writer* w, const char* str) {
+	if (!str) { str = "(null)"; }
+	uint32_t len = strlen(str);
+	uint32_t room = w->end - w->p;
+	if (room < 1 + sizeof(len)) { return; }
+	if (len > room - 1 - sizeof(len)) { len = room - 1 - sizeof(len); }
+	*w->p++ = LOG_ARG_STRING;
+	memcpy(w->p, &len, sizeof(len));
+	memcpy(w->p + sizeof(len), str, len);
+	w->p += sizeof(len) + len;
+	w->num_args++;
+}
+
+inline void log_encode(log_record_writer* w, char* str) {
+	log_encode(w, (const char*)str);
+}
+
+// GLubyte strings, e.g. from glGetString.
+inline void log_encode(log_record_writer* w, const unsigned char* str) {
+	log_encode(w, (const char*)str);
+}
+
+inline void log_encode(log_record_writer* w, unsigned char* str) {
+	log_encode(w, (const char*)str);
+}
+
+template <typename T>
+inline void log_encode(log_record_writer* w, T* ptr) {
+	uint64_t v = (uint64_t)(uintptr_t)ptr;
+	log_encode_raw(w, LOG_ARG_PTR, &v, sizeof(v));
+}
+
+/*
+ * Same call syntax as the old gl_log(const char* msg, ...).
+ */
+template <typename... Args>
+inline int gl_log(const char* msg, const Args&... args) {
+	if (gl_log_mode != LOG_MODE_DEFERRED) {
+		return gl_log_text(msg, args...);
+	}
+	char record[LOG_MAX_MESSAGE];
+	log_record_writer w = { record + sizeof(log_record_header), record + sizeof(record), 0 };
+	int expand[] = { 0, (log_encode(&w, args), 0)... };
+	(void)expand;
+	return push_log_record(msg, record, &w);
+}
+
+#define LOG_AT(level, category, ...) \
+	do { if ((level) >= log_levels[(category)]) { gl_log(__VA_ARGS__); } } while (0)
+#define LOG_COMPILED_OUT(category, ...) ((void)0)
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_TRACE
+#define log_trace(category, ...) LOG_AT(LOG_LEVEL_TRACE, category, __VA_ARGS__)
+#else
+#define log_trace(category, ...) LOG_COMPILED_OUT(category, __VA_ARGS__)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_DEBUG
+#define log_debug(category, ...) LOG_AT(LOG_LEVEL_DEBUG, category, __VA_ARGS__)
+#else
+#define log_debug(category, ...) LOG_COMPILED_OUT(category, __VA_ARGS__)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_INFO
+#define log_info(category, ...) LOG_AT(LOG_LEVEL_INFO, category, __VA_ARGS__)
+#else
+#define log_info(category, ...) LOG_COMPILED_OUT(category, __VA_ARGS__)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_WARN
+#define log_warn(category, ...) LOG_AT(LOG_LEVEL_WARN, category, __VA_ARGS__)
+#else
+#define log_warn(category, ...) LOG_COMPILED_OUT(category, __VA_ARGS__)
+#endif
+
+// Errors also go to stderr, as gl_log_error() does.
+#if LOG_MIN_LEVEL <= LOG_LEVEL_ERROR
+#define log_error(category, ...) \
+	do { if (LOG_LEVEL_ERROR >= log_levels[(category)]) { gl_log_error(__VA_ARGS__); } } while (0)
+#else
+#define log_error(category, ...) LOG_COMPILED_OUT(category, __VA_ARGS__)
+#endif
+
+#endif
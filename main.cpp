@@ -5,11 +5,30 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "gldebug.h"
+#include "glresource.h"
+#include "glstate.h"
 #include "math2d.h"
+#include "materials.h"
+#include "renderqueue.h"
 #include "math3d.h"
+#include "batch.h"
+#include "commands.h"
+#include "framepacing.h"
+#include "gputimer.h"
+#include "instances.h"
+#include "lights.h"
+#include "shader.h"
+#include "shaderwatch.h"
+#include "simclock.h"
+#include "texstream.h"
+#include "texture.h"
+#include "uniforms.h"
 #include "util.h"
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
 
 #define KSHI_AA_SAMPLES 16
 
@@ -20,6 +39,35 @@ void glfw_mouse_pos(GLFWwindow* window, double m_x, double m_y);
 void glfw_mouse_button(GLFWwindow* window, int button, int action, int mods);
 // Bookkeeping.
 void update_fps_counter(GLFWwindow* window);
+// Input and simulation.
+void sample_input(GLFWwindow* window);
+void step_camera(GLFWwindow* window, float step_sec);
+void interpolate_camera(float alpha);
+void add_bench_cube(static_batch* batch, v3 center, float half_size);
+void add_instance_grid(instance_buffer* instances, int count, float extent, float radius);
+// Texture LOD.
+float plane_footprint(const GLfloat* verts, int num_verts, const GLfloat* normal, v3 eye);
+float instances_footprint(const instance_buffer* instances, float radius, v3 eye);
+
+// One draw in the scene's render queue (renderqueue.h): objects
+// [first, first + count) of a batch, or with an instance buffer, that
+// many copies of object 'first'.
+struct scene_draw {
+	GLuint program;
+	// Lights are culled to those reaching this far from center_W, by
+	// whichever thread records the draw.
+	float light_radius;
+	// -1 for no material.
+	int material;
+	const static_batch* batch;
+	int first;
+	int count;
+	GLuint instance_vbo;
+	int instances;
+	// For the depth part of the key, and light culling.
+	v3 center_W;
+};
+void queue_scene_draw(render_queue* queue, std::vector<scene_draw>* draws, const scene_draw& draw, m4 view);
 
 // Basic UI values.
 int g_win_w = 1280;
@@ -27,10 +75,28 @@ int g_win_h = 720;
 // Bookkeeping.
 double prev_seconds;
 int frame_count;
-int ogl_err = -1;
+unsigned long total_frames = 0;
+// Frame pacing (framepacing.h): '-pace vsync', '-pace uncapped' or
+// '-pace 144' for a cap, and '-late_latch on' to sample input as late
+// as possible. The benches always run uncapped.
+frame_pacer pacer;
+// Lights and the camera move in fixed steps (simclock.h), '-sim_hz N' a
+// second, and are drawn interpolated between the last two.
+sim_clock sim;
+double sim_hz = SIM_DEFAULT_HZ;
+int pace_mode = FRAME_PACE_VSYNC;
+double pace_fps = 0.0;
+bool late_latch = false;
+// GL debug output: -gldebug on, or -gldebug break to stop in the
+// debugger on the first GL error.
 bool debug = false;
+gl_debug_settings debug_settings = { false, GL_DEBUG_SEVERITY_LOW };
 // Camera stuff.
 int ubo_cam = 0;
+camera_block cam_uniforms;
+uniform_block cam_ubo_block;
+// Per-frame uniform and light data (see uniformring.h).
+uniform_ring frame_uniforms;
 float cam_speed = 2.0f;
 float cam_yaw_speed = 100.0f;
 float cam_pitch_speed = 100.0f;
@@ -39,7 +105,12 @@ float cam_yaw = 180.0f; // degrees
 float cam_pitch = 0.0f;
 float cam_roll = 0.0f;
 v3 cam_pos(0.0f, 0.0f, -2.0f);
-v3 cam_rot(0.0f, 0.0f, 0.0f);
+// Camera orientation and view, set up in main() and moved by sample_input().
+m4 cam_rot;
+m4 c_view_matrix;
+v4 c_right;
+v4 c_up;
+v4 c_fwd;
 v4 cam_quat_v(0.0f, 0.0f, 1.0f, 0.0f);
 v4 cam_quat_roll_v(0.0f, 0.0f, 0.0f, 1.0f);
 v4 cam_quat_pitch_v(0.0f, 1.0f, 0.0f, 0.0f);
@@ -50,21 +121,46 @@ quat cam_quat_pitch(cam_quat_pitch_v.v[0], cam_quat_pitch_v.v[1], cam_quat_pitch
 v3 target_pos(0.0f, 0.0f, 0.0f);
 v3 y_up(0.0f, 1.0f, 0.0f);
 v3 c_move(0.0f, 0.0f, 0.0f);
-// Lighting stuff.
-int ubo_lights = 1;
+// Where the camera was before the last simulation step.
+v3 prev_cam_pos = cam_pos;
+quat prev_cam_quat = cam_quat;
+// Lighting stuff. '-lights N' adds N small lights roaming the room.
+light_system scene_lights;
 float light_speed = 20.0f;
-float light_z = 7.5f;
-float light2_x = 4.5f;
-int light_dir = -1;
-int light2_dir = -1;
+float light_radius = 100.0f;
+int extra_lights = 0;
+float extra_light_radius = 4.0f;
 // Texture stuff.
-int tex_x, tex_y, tex_n;
-int tex_channels = 4;
-unsigned char* tex_data;
 const char* tex_fn = "textures/png/test_texture.png";
-// Mesh stuff.
-bool mesh_debug = true;
+texture_streamer tex_streamer;
+unsigned long tex_budget = STREAM_DEFAULT_BUDGET;
+// Material textures are looked up through a table instead of bound per
+// draw; bindless if the driver has it, a texture array if not. Cooked
+// ones stream their mips in either way (texstream.h).
+// '-materials off' binds the one texture instead.
+bool use_materials = true;
+const char* material_fns[] = { tex_fn };
+int num_materials = 1;
+material_table materials;
+int mesh_material = 0;
+int room_material = 0;
+// Shader hot reload: edit anything under shaders/ while running.
+bool hot_reload = true;
+shader_watch shader_watcher;
+// Buffers, textures and VAOs are set up with direct state access when
+// the driver has it (glresource.h); '-dsa off' forces bind-to-edit.
+bool use_dsa = true;
+// Scene draws are recorded on worker threads and replayed on this one
+// (commands.h). '-record_threads N' sets how many; -1 is one per core
+// after this one.
+int record_threads = -1;
+// Mesh stuff. More than one instance fills the room with copies.
+int mesh_instances = 1;
 const char* mesh_fn = "meshes/twisty_box.dae";
+// Rough bounding spheres around the origin, for texture LOD and
+// light culling.
+float mesh_radius = 1.5f;
+float room_radius = 17.4f;
 // Mouse stuff.
 double mouse_x = 0.0f;
 double mouse_y = 0.0f;
@@ -77,12 +173,84 @@ float fov = 50.625f;
 float a_ratio = (float)g_win_w / (float)g_win_h;
 bool update_proj_matrix = false;
 
+// Benchmarks. './main -bench lights' times the scene's fragment work with
+// light positions transformed per fragment (the old way), then once per
+// frame on the CPU, logs both and quits.
+bool bench_lights = false;
+#define BENCH_WARMUP_FRAMES 60
+#define BENCH_FRAMES 600
+const char* bench_phase_names[] = { "per-fragment V * light", "eye-space lights from CPU" };
+// './main -bench batch' adds BENCH_BATCH_OBJECTS small static cubes and
+// draws them one VAO at a time, then as one glMultiDrawArrays, then as one
+// glMultiDrawArraysIndirect, logging draw calls and CPU submission time.
+bool bench_batch = false;
+#define BENCH_BATCH_OBJECTS 4096
+const char* batch_phase_names[] = { "separate VAOs", "glMultiDrawArrays", "glMultiDrawArraysIndirect" };
+// './main -bench instances' fills the room with BENCH_INSTANCES copies of
+// the mesh and draws them one draw call each, then as one instanced draw,
+// logging CPU submission and GPU time for both.
+bool bench_instances = false;
+#define BENCH_INSTANCES 100000
+const char* instance_phase_names[] = { "draw per instance", "glDrawArraysInstanced" };
+
 // Shaders. Better to load these from text files, but for now...
 const char* vertex_shader_fn = "shaders/vert/test.vert";
 const char* frag_shader_fn = "shaders/frag/test.frag";
+// Drawn with while the real programs compile.
+const char* fallback_frag_fn = "shaders/frag/fallback.frag";
 
 int main(int argc, char** args) {
 	assert(restart_gl_log() == 0);
+	// The mesh dump is on unless -log says otherwise.
+	set_log_level(LOG_MESH, LOG_LEVEL_DEBUG);
+	for (int i=1; i+1<argc; i++) {
+		if (strcmp(args[i], "-bench") == 0 && strcmp(args[i+1], "lights") == 0) {
+			bench_lights = true;
+		}
+		if (strcmp(args[i], "-bench") == 0 && strcmp(args[i+1], "batch") == 0) {
+			bench_batch = true;
+		}
+		if (strcmp(args[i], "-bench") == 0 && strcmp(args[i+1], "instances") == 0) {
+			bench_instances = true;
+			mesh_instances = BENCH_INSTANCES;
+		}
+		if (strcmp(args[i], "-instances") == 0) {
+			mesh_instances = atoi(args[i+1]);
+		}
+		if (strcmp(args[i], "-lights") == 0) {
+			extra_lights = atoi(args[i+1]);
+		}
+		if (strcmp(args[i], "-gldebug") == 0) {
+			debug = strcmp(args[i+1], "off") != 0;
+			debug_settings.break_on_error = strcmp(args[i+1], "break") == 0;
+		}
+		if (strcmp(args[i], "-pace") == 0) {
+			if (strcmp(args[i+1], "vsync") == 0) { pace_mode = FRAME_PACE_VSYNC; }
+			else if (strcmp(args[i+1], "uncapped") == 0) { pace_mode = FRAME_PACE_UNCAPPED; }
+			else {
+				pace_mode = FRAME_PACE_CAPPED;
+				pace_fps = atof(args[i+1]);
+			}
+		}
+		if (strcmp(args[i], "-sim_hz") == 0) {
+			sim_hz = atof(args[i+1]);
+		}
+		if (strcmp(args[i], "-late_latch") == 0) {
+			late_latch = strcmp(args[i+1], "off") != 0;
+		}
+		if (strcmp(args[i], "-dsa") == 0) {
+			use_dsa = strcmp(args[i+1], "off") != 0;
+		}
+		if (strcmp(args[i], "-materials") == 0) {
+			use_materials = strcmp(args[i+1], "off") != 0;
+		}
+		if (strcmp(args[i], "-record_threads") == 0) {
+			record_threads = atoi(args[i+1]);
+		}
+		if (strcmp(args[i], "-log") == 0) {
+			set_log_levels(args[i+1]);
+		}
+	}
 
 	// Initialize GLFW and GLEW.
 	gl_log("Initialize GLFW\n%s\n", glfwGetVersionString());
@@ -92,7 +260,7 @@ int main(int argc, char** args) {
 		return 1;
 	}
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 	// Anti-aliasing is nice.
@@ -133,8 +301,18 @@ int main(int argc, char** args) {
 	glewInit();
 
 	// Setup extensions, if possible.
+	gl_ext_check();
+	if (!use_dsa && gl_caps.direct_state_access) {
+		gl_log("Direct state access off (-dsa off)\n");
+		gl_caps.direct_state_access = false;
+	}
+	if (bench_lights || bench_batch || bench_instances) {
+		// Don't let vsync hide anything.
+		pace_mode = FRAME_PACE_UNCAPPED;
+	}
+	init_frame_pacer(&pacer, pace_mode, pace_fps, late_latch);
 	if (debug) {
-		gl_ext_check(&ogl_err);
+		init_gl_debug(&debug_settings);
 	}
 
 	// Get compatibility information.
@@ -144,7 +322,7 @@ int main(int argc, char** args) {
 	printf("OpenGL version supported: %s\n", version);
 
 	// Depth testing; enable and define less depth as 'closer'.
-	glEnable(GL_DEPTH_TEST);
+	gl_enable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LESS);
 
 	// Create 3 points for a triangle.
@@ -334,149 +512,140 @@ int main(int argc, char** args) {
 		}
 	};
 
-	// Create the VBOs.
-	GLuint points_vbo = 0;
-	glGenBuffers(1, &points_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, points_vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(points), points, GL_STATIC_DRAW);
-	GLuint points2_vbo = 0;
-	glGenBuffers(1, &points2_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, points2_vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(points2), points2, GL_STATIC_DRAW);
-	GLuint normals_vbo = 0;
-	glGenBuffers(1, &normals_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, normals_vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(normals), normals, GL_STATIC_DRAW);
-	GLuint tri_tex_vbo = 0;
-	glGenBuffers(1, &tri_tex_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, tri_tex_vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(tri_texcoords), tri_texcoords, GL_STATIC_DRAW);
-	// Create plane VBOs.
-	GLuint plane_vbos[6] = {0, 0, 0, 0, 0, 0};
-	glGenBuffers(6, plane_vbos);
-	GLuint plane_normal_vbos[6] = {0, 0, 0, 0, 0, 0};
-	glGenBuffers(6, plane_normal_vbos);
-	GLuint plane_tex_vbos[6] = {0, 0, 0, 0, 0, 0};
-	glGenBuffers(6, plane_tex_vbos);
+	// All of the above shares a vertex format, so it goes in one static
+	// batch with the mesh: one buffer, one VAO, a draw call per program.
+	static_batch scene_batch;
+	init_static_batch(&scene_batch);
+	int triangles_first = add_static_mesh(&scene_batch, points, normals, tri_texcoords, 3);
+	add_static_mesh(&scene_batch, points2, normals, tri_texcoords, 3);
+	int planes_first = 0;
 	for (int i=0; i<6; i++) {
-		glBindBuffer(GL_ARRAY_BUFFER, plane_vbos[i]);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(planes[i]), planes[i], GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, plane_normal_vbos[i]);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(plane_normals[i]), plane_normals[i], GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, plane_tex_vbos[i]);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(plane_texcoords[i]), plane_texcoords[i], GL_STATIC_DRAW);
-	}
-
-	// Create the VAOs.
-	GLuint vao = 0;
-	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
-	glBindBuffer(GL_ARRAY_BUFFER, points_vbo);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-	glBindBuffer(GL_ARRAY_BUFFER, normals_vbo);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-	glBindBuffer(GL_ARRAY_BUFFER, tri_tex_vbo);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, NULL);
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
-	glEnableVertexAttribArray(2);
-	GLuint vao2 = 0;
-	glGenVertexArrays(1, &vao2);
-	glBindVertexArray(vao2);
-	glBindBuffer(GL_ARRAY_BUFFER, points2_vbo);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-	glBindBuffer(GL_ARRAY_BUFFER, normals_vbo);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-	glBindBuffer(GL_ARRAY_BUFFER, tri_tex_vbo);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, NULL);
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
-	glEnableVertexAttribArray(2);
-	// Create plane VAOs.
-	GLuint plane_vaos[6] = {0, 0, 0, 0, 0, 0};
-	glGenVertexArrays(6, plane_vaos);
-	for (int i=0; i<6; i++) {
-		glBindVertexArray(plane_vaos[i]);
-		glBindBuffer(GL_ARRAY_BUFFER, plane_vbos[i]);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-		glBindBuffer(GL_ARRAY_BUFFER, plane_normal_vbos[i]);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-		glBindBuffer(GL_ARRAY_BUFFER, plane_tex_vbos[i]);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, NULL);
-		glEnableVertexAttribArray(0);
-		glEnableVertexAttribArray(1);
-		glEnableVertexAttribArray(2);
-	}
-
-	// Load the mesh.
-	GLuint mesh_vao = 0;
-	int num_vertices = 0;
-	loadMesh(mesh_fn, &mesh_vao, &num_vertices, mesh_debug);
-
-	// Load and bind textures.
-	// Load texture data.
-	tex_data = stbi_load(tex_fn, &tex_x, &tex_y, &tex_n, tex_channels);
-	if (!tex_data) {
-		gl_log_error("ERROR: Could not load image: %s\n", tex_fn);
-	}
-	if ((tex_x & (tex_x-1)) != 0 || (tex_y & (tex_y-1) != 0)) {
-		gl_log("WARN:  texture %s has x or y % 2 != 0", tex_fn);
-	}
-	// Flip the texture vertically.
-	flip_tex_V(tex_data, tex_x, tex_y, tex_n);
-
-	// Bind texture data.
-	int mipmap_LOD = 0;
+		int plane = add_static_mesh(&scene_batch, planes[i], plane_normals[i], plane_texcoords[i], 6);
+		if (i == 0) { planes_first = plane; }
+	}
+	int mesh_object = 0;
+	loadMesh(mesh_fn, &scene_batch, &mesh_object);
+	build_static_batch(&scene_batch);
+	vertex_format* static_format = static_vertex_format();
+
+	// Lots of little things, for the batching benchmark.
+	static_batch bench_objects;
+	std::vector<GLuint> bench_vaos, bench_vbos;
+	int batch_phase = 0;
+	int batch_frame = 0;
+	double batch_ms = 0.0;
+	unsigned long batch_calls = 0;
+	if (bench_batch) {
+		init_static_batch(&bench_objects);
+		for (int i=0; i<BENCH_BATCH_OBJECTS; i++) {
+			v3 center((rand() % 1800) / 100.0f - 9.0f, (rand() % 1800) / 100.0f - 9.0f,
+					  (rand() % 1800) / 100.0f - 9.0f);
+			add_bench_cube(&bench_objects, center, 0.1f);
+		}
+		build_static_batch(&bench_objects);
+		build_separate_vaos(&bench_objects, &bench_vaos, &bench_vbos);
+	}
+
+	// Copies of the mesh.
+	set_default_model_matrix();
+	instance_buffer mesh_transforms;
+	init_instance_buffer(&mesh_transforms);
+	if (mesh_instances > 1) {
+		add_instance_grid(&mesh_transforms, mesh_instances, 9.5f, mesh_radius);
+	}
+	else {
+		add_instance(&mesh_transforms, id4());
+	}
+	upload_instances(&mesh_transforms);
+	int num_instances = mesh_transforms.transforms.size();
+	// Rebuilt every frame.
+	render_queue scene_queue;
+	std::vector<scene_draw> scene_draws;
+	command_recorder recorder;
+	init_command_recorder(&recorder, record_threads);
+	std::vector<command_list> scene_lists;
+	// Per list, so recording threads never share them.
+	std::vector<std::vector<light_list> > list_lights;
+	std::vector<std::vector<GLuint> > list_light_indices;
+	double record_ms = 0.0;
+	light_list bench_lights_list = { 0, 0 };
+	gpu_timer instance_timer;
+	int instance_phase = 0;
+	int instance_frame = 0;
+	double instance_ms = 0.0;
+	if (bench_instances) {
+		init_gpu_timer(&instance_timer);
+	}
+
+	// Load and bind textures. Cooked textures (textures/ktex/) are
+	// streamed in by mip level; anything else is loaded whole.
 	GLuint tex = 0;
-	glGenTextures(1, &tex);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, tex);
-	glTexImage2D(GL_TEXTURE_2D,
-				 mipmap_LOD, GL_SRGB_ALPHA, tex_x, tex_y,
-				 0, GL_RGBA, GL_UNSIGNED_BYTE,
-				 tex_data);
-	// Some basic texture parameters.
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	// Generate mipmaps.
-	glGenerateMipmap(GL_TEXTURE_2D);
-	// Enable max supported level of anisotropic filtering.
-	GLfloat max_anisotropic = 0.0f;
-	glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &max_anisotropic);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, max_anisotropic);
-	//printf("Using %.2f anisotropic samples\n", max_anisotropic);
-
-	// Compile the shaders.
-	GLuint vs = glCreateShader(GL_VERTEX_SHADER);
-	loadShader(vertex_shader_fn, vs);
-	GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
-	loadShader(frag_shader_fn, fs);
-	GLuint shader_prog = glCreateProgram();
-	glAttachShader(shader_prog, fs);
-	glAttachShader(shader_prog, vs);
-	glLinkProgram(shader_prog);
-
-	// Log shader linking errors.
-	int params = -1;
-	glGetProgramiv(shader_prog, GL_LINK_STATUS, &params);
-	if (GL_TRUE != params) {
-		gl_log_error("(%i) Error in shader linking!\n", shader_prog);
-		int actual_length = 0;
-		char log[GL_SHADER_LOG_LEN];
-		glGetProgramInfoLog(shader_prog, GL_SHADER_LOG_LEN, &actual_length, log);
-		gl_log("Shader log:\n---\n%s---\n", log);
+	int tex_handle = -1;
+	init_texture_streamer(&tex_streamer, tex_budget);
+	if (use_materials) {
+		build_material_table(&materials, material_fns, num_materials, &tex_streamer);
+	}
+	else {
+		tex_handle = stream_texture(&tex_streamer, tex_fn, &tex);
+		gl_active_texture(GL_TEXTURE0);
+		if (tex_handle < 0) {
+			loadTexture(tex_fn, &tex);
+		}
+		else {
+			gl_bind_texture(GL_TEXTURE_2D, tex);
+		}
+		// Some basic texture parameters.
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		// Enable max supported level of anisotropic filtering.
+		GLfloat max_anisotropic = 0.0f;
+		glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &max_anisotropic);
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, max_anisotropic);
+		//printf("Using %.2f anisotropic samples\n", max_anisotropic);
+	}
+	// What each textured object streams, if anything.
+	int room_stream = use_materials ? material_stream_handle(&materials, room_material) : tex_handle;
+	int mesh_stream = use_materials ? material_stream_handle(&materials, mesh_material) : tex_handle;
+
+	// Compile the shaders (or fetch them from the program cache),
+	// one permutation per kind of surface so each gets the cheapest one.
+	// They're all issued here and build in the background; anything not
+	// ready yet draws with the fallback.
+	if (initFallbackProgram(vertex_shader_fn, fallback_frag_fn) != 0) {
+		gl_log_error("ERROR: fallback program didn't link\n");
+	}
+	shader_defines lit_defines;
+	shader_defines textured_defines = lit_defines;
+	define(&textured_defines, "TEXTURED");
+	if (use_materials) {
+		define(&textured_defines, material_shader_define(&materials));
+	}
+	int textured_prog = getProgram(vertex_shader_fn, frag_shader_fn, &textured_defines);
+	int untextured_prog = getProgram(vertex_shader_fn, frag_shader_fn, &lit_defines);
+	// Same again, transforming lights per fragment, to benchmark against.
+	int world_textured_prog = textured_prog;
+	int world_untextured_prog = untextured_prog;
+	if (bench_lights) {
+		define(&lit_defines, "LIGHTS_WORLD_SPACE");
+		define(&textured_defines, "LIGHTS_WORLD_SPACE");
+		world_textured_prog = getProgram(vertex_shader_fn, frag_shader_fn, &textured_defines);
+		world_untextured_prog = getProgram(vertex_shader_fn, frag_shader_fn, &lit_defines);
+	}
+	log_program_cache_stats();
+	if (hot_reload) {
+		init_shader_watch(&shader_watcher, SHADER_WATCH_DIR);
 	}
 
 	// Setup initial camera values.
 	m4 cam_trans = translation_matrix(cam_pos.v[0], cam_pos.v[1], cam_pos.v[2]);
-	m4 cam_rot = quaternion_to_rotation(cam_quat);
-	m4 c_view_matrix = look_at(cam_pos, target_pos, y_up);
+	cam_rot = quaternion_to_rotation(cam_quat);
+	c_view_matrix = look_at(cam_pos, target_pos, y_up);
 	m4 persp_matrix = perspective(near, far, fov, a_ratio);
-	v4 c_right(c_view_matrix.m[0], c_view_matrix.m[1], c_view_matrix.m[2], 0.0f);
-	v4 c_up(c_view_matrix.m[4], c_view_matrix.m[5], c_view_matrix.m[6], 0.0f);
-	v4 c_fwd(-c_view_matrix.m[8], -c_view_matrix.m[9], -c_view_matrix.m[10], 0.0f);
+	c_right = v4(c_view_matrix.m[0], c_view_matrix.m[1], c_view_matrix.m[2], 0.0f);
+	c_up = v4(c_view_matrix.m[4], c_view_matrix.m[5], c_view_matrix.m[6], 0.0f);
+	c_fwd = v4(-c_view_matrix.m[8], -c_view_matrix.m[9], -c_view_matrix.m[10], 0.0f);
 
 	float speed = 1.0f;
 	float last_pos = 0.5f;
@@ -509,229 +678,341 @@ int main(int argc, char** args) {
 	glUniform3f(light2_ambient_loc, 0.2f, 0.2f, 0.2f);
 	*/
 
-	glUseProgram(shader_prog);
-
 	// Setup uniform buffer objects.
-	// One for camera values, one for lighting values.
-	GLuint cam_block_buffer;
-	glGenBuffers(1, &cam_block_buffer);
-	glBindBuffer(GL_UNIFORM_BUFFER, cam_block_buffer);
-	// Store view and projection matrices; 2 * 16 floats.
-	glBufferData(GL_UNIFORM_BUFFER, sizeof(float) * 32, NULL, GL_DYNAMIC_DRAW);
-	GLuint cam_ubo_index = glGetUniformBlockIndex(shader_prog, "cam_ubo");
-	glUniformBlockBinding(shader_prog, cam_ubo_index, ubo_cam);
-	glBindBufferBase(GL_UNIFORM_BUFFER, ubo_cam, cam_block_buffer);
-	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(float) * 16, transpose(c_view_matrix).m);
-	glBufferSubData(GL_UNIFORM_BUFFER, sizeof(float) * 16, sizeof(float) * 16, transpose(persp_matrix).m);
-
-	GLuint lights_block_buffer;
-	glGenBuffers(1, &lights_block_buffer);
-	glBindBuffer(GL_UNIFORM_BUFFER, lights_block_buffer);
-	// Store position, specular, diffuse, and ambient values for 2 lights.
-	// We'll use v4's, so that's 16 * 2 floats.
-	glBufferData(GL_UNIFORM_BUFFER, sizeof(float) * 32, NULL, GL_DYNAMIC_DRAW);
-	GLuint lights_ubo_index = glGetUniformBlockIndex(shader_prog, "lights_ubo");
-	glUniformBlockBinding(shader_prog, lights_ubo_index, ubo_lights);
-	glBindBufferBase(GL_UNIFORM_BUFFER, ubo_lights, lights_block_buffer);
-	float light_pos[] = { 7.5f, 7.5f, light_z, 1.0f };
-	float light2_pos[] = { light2_x, 7.5f, 6.5f, 1.0f };
-	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(float) * 4, light_pos);
-	glBufferSubData(GL_UNIFORM_BUFFER, sizeof(float) * 4, sizeof(float) * 4, light2_pos);
-	float light_spec[] = { 1.0f, 1.0f, 1.0f, 0.0f };
-	float light_diffuse[] = { 0.5f, 0.7f, 0.5f, 0.0f };
-	float light_ambient[] = { 0.2f, 0.2f, 0.2f, 0.0f };
-	glBufferSubData(GL_UNIFORM_BUFFER, sizeof(float) * 8, sizeof(float) * 4, light_spec);
-	glBufferSubData(GL_UNIFORM_BUFFER, sizeof(float) * 12, sizeof(float) * 4, light_diffuse);
-	glBufferSubData(GL_UNIFORM_BUFFER, sizeof(float) * 16, sizeof(float) * 4, light_ambient);
-	float light2_diffuse[] = { 0.5f, 0.5f, 0.7f, 0.0f };
-	glBufferSubData(GL_UNIFORM_BUFFER, sizeof(float) * 20, sizeof(float) * 4, light_spec);
-	glBufferSubData(GL_UNIFORM_BUFFER, sizeof(float) * 24, sizeof(float) * 4, light2_diffuse);
-	glBufferSubData(GL_UNIFORM_BUFFER, sizeof(float) * 28, sizeof(float) * 4, light_ambient);
-
-	bool cam_moved = true;
+	// Camera values go in a uniform block, lights in storage buffers;
+	// binding points are set in the shaders (shaders/include/).
+	// Each frame's copies are suballocated from one persistent mapped
+	// ring, so updating them never waits on the GPU.
+	// The camera block is written from a CPU mirror (see uniforms.h),
+	// checked against the real layout once a program using it has linked.
+	init_uniform_ring(&frame_uniforms, UNIFORM_RING_FRAME_SIZE);
+	cam_uniforms.V = transpose(c_view_matrix);
+	cam_uniforms.P = transpose(persp_matrix);
+	init_uniform_block(&cam_ubo_block, "cam_ubo", ubo_cam, &cam_uniforms, sizeof(cam_uniforms));
+	bool cam_ubo_checked = false;
+
+	// Lights: two sweeping across the room, plus any extras.
+	init_light_system(&scene_lights);
+	v3 light_spec(1.0f, 1.0f, 1.0f);
+	v3 light_ambient(0.2f, 0.2f, 0.2f);
+	int light1 = add_light(&scene_lights, v3(7.5f, 7.5f, 7.5f), light_radius,
+						   light_spec, v3(0.5f, 0.7f, 0.5f), light_ambient);
+	animate_light(&scene_lights, light1, v3(0.0f, 0.0f, -light_speed),
+				  v3(7.5f, 7.5f, -8.0f), v3(7.5f, 7.5f, 8.0f));
+	int light2 = add_light(&scene_lights, v3(4.5f, 7.5f, 6.5f), light_radius,
+						   light_spec, v3(0.5f, 0.5f, 0.7f), light_ambient);
+	animate_light(&scene_lights, light2, v3(-light_speed, 0.0f, 0.0f),
+				  v3(-8.0f, 7.5f, 6.5f), v3(8.0f, 7.5f, 6.5f));
+	for (int i=0; i<extra_lights; i++) {
+		float r = (float)rand() / RAND_MAX;
+		float g = (float)rand() / RAND_MAX;
+		float b = (float)rand() / RAND_MAX;
+		v3 pos(rand() % 18 - 9.0f, rand() % 18 - 9.0f, rand() % 18 - 9.0f);
+		int light = add_light(&scene_lights, pos, extra_light_radius,
+							  v3(r, g, b), v3(r, g, b), v3(0.0f, 0.0f, 0.0f));
+		v3 vel(rand() % 9 - 4.0f, rand() % 9 - 4.0f, rand() % 9 - 4.0f);
+		animate_light(&scene_lights, light, vel, v3(-9.5f, -9.5f, -9.5f), v3(9.5f, 9.5f, 9.5f));
+	}
+	gl_log("%i lights\n", (int)scene_lights.pos_W.size());
+
+	gpu_timer bench_timer;
+	int bench_phase = 0;
+	int bench_frame = 0;
+	double bench_ns[2] = { 0.0, 0.0 };
+	if (bench_lights) {
+		init_gpu_timer(&bench_timer);
+	}
+
+	init_sim_clock(&sim, sim_hz, glfwGetTime());
 	while (!glfwWindowShouldClose(window)) {
-		cam_yaw = cam_roll = cam_pitch = 0.0f;
-		c_move.v[0] = c_move.v[1] = c_move.v[2] = 0.0f;
-		static double prev_sec = glfwGetTime();
-		double cur_sec = glfwGetTime();
-		double elapsed_sec = cur_sec - prev_sec;
-		prev_sec = cur_sec;
-
-		// Update light positions.
-		light_z += light_dir * light_speed * elapsed_sec;
-		light2_x += light2_dir * light_speed * elapsed_sec;
-		if (light_z >= 8.0f) { light_dir = -1; }
-		else if (light_z <= -8.0f) { light_dir = 1; }
-		if (light2_x >= 8.0f) { light2_dir = -1; }
-		else if (light2_x <= -8.0f) { light2_dir = 1; }
-		// Update shaders.
-		glBindBuffer(GL_UNIFORM_BUFFER, lights_block_buffer);
-		glBindBufferBase(GL_UNIFORM_BUFFER, ubo_lights, lights_block_buffer);
-		light_pos[2] = light_z;
-		light2_pos[0] = light2_x;
-		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(float) * 4, light_pos);
-		glBufferSubData(GL_UNIFORM_BUFFER, sizeof(float) * 4, sizeof(float) * 4, light2_pos);
+		// Capped frames wait here for their start time. Input is sampled
+		// and the simulation stepped right after, or with late latching,
+		// right before the scene is submitted. Then the queue is sorted
+		// and the lights culled where things were last frame; a frame's
+		// movement is well inside the light radii.
+		wait_for_frame(&pacer);
+		if (!pacer.late_latch) {
+			sample_input(window);
+		}
 		//glUniform3f(light_pos_loc, 7.5f, 7.5f, light_z);
 		//glUniform3f(light2_pos_loc, light2_x, 7.5f, 6.5f);
 
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		glViewport(0, 0, g_win_w, g_win_h);
+		gl_viewport(0, 0, g_win_w, g_win_h);
 		update_fps_counter(window);
 
 		// Only update the projection matrix if necessary.
 		if (update_proj_matrix) {
 			persp_matrix = perspective(near, far, fov, a_ratio);
-			glBindBuffer(GL_UNIFORM_BUFFER, cam_block_buffer);
-			glBindBufferBase(GL_UNIFORM_BUFFER, ubo_cam, cam_block_buffer);
-			glBufferSubData(GL_UNIFORM_BUFFER, sizeof(float) * 16, sizeof(float) * 16, transpose(persp_matrix).m);
+			cam_uniforms.P = transpose(persp_matrix);
 			//glUniformMatrix4fv(proj_matrix_loc, 1, GL_TRUE, persp_matrix.m);
 			update_proj_matrix = false;
 		}
 
-		// Check input.
-		glfwPollEvents();
-		// Escape = quit.
-		if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
-			glfwSetWindowShouldClose(window, 1);
-		}
-		// Camera movement. First update vectors, then apply transformations.
-		// khjluo for rotation
-		if (glfwGetKey(window, GLFW_KEY_H)) {
-			cam_yaw -= cam_yaw_speed * elapsed_sec;
-			cam_quat_yaw = set(cam_yaw, c_up);
-			cam_quat = cam_quat * cam_quat_yaw;
-			cam_rot = quaternion_to_rotation(cam_quat);
-			c_right = cam_rot.row(0);
-			c_up = cam_rot.row(1);
-			c_fwd = cam_rot.row(2) * -1.0f;
-			cam_moved = true;
-		}
-		if (glfwGetKey(window, GLFW_KEY_L)) {
-			cam_yaw += cam_yaw_speed * elapsed_sec;
-			cam_quat_yaw = normalize(set(cam_yaw, c_up));
-			cam_quat = cam_quat * cam_quat_yaw;
-			cam_rot = quaternion_to_rotation(cam_quat);
-			c_right = cam_rot.row(0);
-			c_up = cam_rot.row(1);
-			c_fwd = cam_rot.row(2) * -1.0f;
-			cam_moved = true;
-		}
-		if (glfwGetKey(window, GLFW_KEY_K)) {
-			cam_pitch -= cam_pitch_speed * elapsed_sec;
-			cam_quat_pitch = normalize(set(cam_pitch, c_right));
-			cam_quat = cam_quat * cam_quat_pitch;
-			cam_rot = quaternion_to_rotation(cam_quat);
-			c_right = cam_rot.row(0);
-			c_up = cam_rot.row(1);
-			c_fwd = cam_rot.row(2) * -1.0f;
-			cam_moved = true;
-		}
-		if (glfwGetKey(window, GLFW_KEY_J)) {
-			cam_pitch += cam_pitch_speed * elapsed_sec;
-			cam_quat_pitch = normalize(set(cam_pitch, c_right));
-			cam_quat = cam_quat * cam_quat_pitch;
-			cam_rot = quaternion_to_rotation(cam_quat);
-			c_right = cam_rot.row(0);
-			c_up = cam_rot.row(1);
-			c_fwd = cam_rot.row(2) * -1.0f;
-			cam_moved = true;
-		}
-		if (glfwGetKey(window, GLFW_KEY_U)) {
-			cam_roll += cam_roll_speed * elapsed_sec;
-			cam_quat_roll = normalize(set(cam_roll, c_fwd));
-			cam_quat = cam_quat * cam_quat_roll;
-			cam_rot = quaternion_to_rotation(cam_quat);
-			c_right = cam_rot.row(0);
-			c_up = cam_rot.row(1);
-			c_fwd = cam_rot.row(2) * -1.0f;
-			cam_moved = true;
-		}
-		if (glfwGetKey(window, GLFW_KEY_O)) {
-			cam_roll -= cam_roll_speed * elapsed_sec;
-			cam_quat_roll = normalize(set(cam_roll, c_fwd));
-			cam_quat = cam_quat * cam_quat_roll;
-			cam_rot = quaternion_to_rotation(cam_quat);
-			c_right = cam_rot.row(0);
-			c_up = cam_rot.row(1);
-			c_fwd = cam_rot.row(2) * -1.0f;
-			cam_moved = true;
-		}
-		// wasd for movement.
-		if (glfwGetKey(window, GLFW_KEY_A)) {
-			c_move.v[0] += c_right.v[0] * cam_speed * elapsed_sec;
-			c_move.v[1] += c_right.v[1] * cam_speed * elapsed_sec;
-			c_move.v[2] += c_right.v[2] * cam_speed * elapsed_sec;
-			cam_moved = true;
-		}
-		if (glfwGetKey(window, GLFW_KEY_D)) {
-			c_move.v[0] -= c_right.v[0] * cam_speed * elapsed_sec;
-			c_move.v[1] -= c_right.v[1] * cam_speed * elapsed_sec;
-			c_move.v[2] -= c_right.v[2] * cam_speed * elapsed_sec;
-			cam_moved = true;
-		}
-		if (glfwGetKey(window, GLFW_KEY_W)) {
-			c_move.v[0] -= c_fwd.v[0] * cam_speed * elapsed_sec;
-			c_move.v[1] -= c_fwd.v[1] * cam_speed * elapsed_sec;
-			c_move.v[2] -= c_fwd.v[2] * cam_speed * elapsed_sec;
-			cam_moved = true;
-		}
-		if (glfwGetKey(window, GLFW_KEY_S)) {
-			c_move.v[0] += c_fwd.v[0] * cam_speed * elapsed_sec;
-			c_move.v[1] += c_fwd.v[1] * cam_speed * elapsed_sec;
-			c_move.v[2] += c_fwd.v[2] * cam_speed * elapsed_sec;
-			cam_moved = true;
-		}
-		if (glfwGetKey(window, GLFW_KEY_Q)) {
-			c_move.v[0] += c_up.v[0] * cam_speed * elapsed_sec;
-			c_move.v[1] += c_up.v[1] * cam_speed * elapsed_sec;
-			c_move.v[2] += c_up.v[2] * cam_speed * elapsed_sec;
-			cam_moved = true;
-		}
-		if (glfwGetKey(window, GLFW_KEY_E)) {
-			c_move.v[0] -= c_up.v[0] * cam_speed * elapsed_sec;
-			c_move.v[1] -= c_up.v[1] * cam_speed * elapsed_sec;
-			c_move.v[2] -= c_up.v[2] * cam_speed * elapsed_sec;
-			cam_moved = true;
-		}
-
-		// Updates based on camera movement.
-		if (cam_moved) {
-			printf("CQ: %s\n", print(cam_quat).c_str());
-			cam_pos.v[0] += c_move.v[0];
-			cam_pos.v[1] += c_move.v[1];
-			cam_pos.v[2] += c_move.v[2];
-			m4 cam_trans = translation_matrix(cam_pos.v[0], cam_pos.v[1], cam_pos.v[2]);
-			c_view_matrix = view_matrix(cam_trans, cam_rot);
-
-			printf("Yaw:   %.2f\nRoll:  %.2f\nPitch: %.2f\n", cam_yaw, cam_roll, cam_pitch);
-			printf("Up:    %s\nRight: %s\nFwd:   %s\n", print(c_up).c_str(), print(c_right).c_str(), print(c_fwd).c_str());
-			printf("Rotation matrix:\n%s\n", print(quaternion_to_rotation(cam_quat)).c_str());
-
-			// Don't forget to tell the shaders.
-			glBindBuffer(GL_UNIFORM_BUFFER, cam_block_buffer);
-			glBindBufferBase(GL_UNIFORM_BUFFER, ubo_cam, cam_block_buffer);
-			glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(float) * 16, transpose(c_view_matrix).m);
-			//glUniformMatrix4fv(view_matrix_loc, 1, GL_TRUE, c_view_matrix.m);
-
-			cam_moved = false;
+		// Pick up edited shaders; whatever's finished compiling is swapped in.
+		if (hot_reload) {
+			update_shader_watch(&shader_watcher);
+		}
+		update_programs();
+		if (!cam_ubo_checked && programReady(textured_prog)) {
+			reflect_uniform_block(&cam_ubo_block, programObject(textured_prog), camera_block_fields());
+			cam_ubo_checked = true;
+		}
+
+		// Ask for the texture detail each textured object needs: the
+		// room from its nearest plane, the mesh from its nearest copy.
+		if (room_stream >= 0) {
+			float footprint = 0.0f;
+			for (int i=0; i<6; i++) {
+				float plane = plane_footprint(planes[i], 6, plane_normals[i], cam_pos);
+				if (plane > footprint) { footprint = plane; }
+			}
+			request_texture_lod(&tex_streamer, room_stream, footprint);
+		}
+		if (mesh_stream >= 0) {
+			request_texture_lod(&tex_streamer, mesh_stream,
+								instances_footprint(&mesh_transforms, mesh_radius, cam_pos));
+		}
+		update_texture_streamer(&tex_streamer);
+
+		// Lights go to the shaders in eye space: one transform per light
+		// here instead of one per light per fragment. The shared lists
+		// are only for the batch bench; scene draws are culled as
+		// they're recorded.
+		bool world_lights = bench_lights && bench_phase == 0;
+		reset_light_lists(&scene_lights);
+		if (bench_batch) {
+			bench_lights_list = cull_lights(&scene_lights, v3(0.0f, 0.0f, 0.0f), room_radius);
 		}
+		begin_uniform_ring_frame(&frame_uniforms);
+
+		// Queue the scene, then draw it grouped by state and front to back.
+		GLuint untextured = programObject(world_lights ? world_untextured_prog : untextured_prog);
+		GLuint textured = programObject(world_lights ? world_textured_prog : textured_prog);
+		int material = use_materials ? room_material : -1;
+		clear_render_queue(&scene_queue);
+		scene_draws.clear();
+		scene_draw triangles = { untextured, 1.0f, -1, &scene_batch, triangles_first, 2, 0, 1,
+								 v3(0.0f, 0.0f, 0.25f) };
+		queue_scene_draw(&scene_queue, &scene_draws, triangles, c_view_matrix);
+		scene_draw room = { textured, room_radius, material, &scene_batch, planes_first, 6, 0, 1,
+							v3(0.0f, 0.0f, 0.0f) };
+		queue_scene_draw(&scene_queue, &scene_draws, room, c_view_matrix);
+		material = use_materials ? mesh_material : -1;
+		scene_draw mesh = { textured, (num_instances > 1) ? room_radius : mesh_radius, material, &scene_batch,
+							mesh_object, 1, mesh_transforms.vbo, num_instances, v3(0.0f, 0.0f, 0.0f) };
+		queue_scene_draw(&scene_queue, &scene_draws, mesh, c_view_matrix);
+		sort_render_queue(&scene_queue);
+
+		// Record the sorted draws in buckets, a list each, on the worker
+		// threads, then replay them here in order. Each bucket culls its
+		// draws' lights into its own index array first, which goes in
+		// the list ahead of the draws.
+		int num_items = scene_queue.items.size();
+		int num_lists = recorder.threads.size() + 1;
+		if (num_lists > num_items) { num_lists = (num_items > 0) ? num_items : 1; }
+		scene_lists.resize(num_lists);
+		list_lights.resize(num_lists);
+		list_light_indices.resize(num_lists);
+		double submit_start = glfwGetTime();
+		record_command_lists(&recorder, &scene_lists, [&](int list, command_list* commands) {
+			int first = num_items * list / num_lists;
+			int last = num_items * (list + 1) / num_lists;
+			std::vector<light_list>& lights = list_lights[list];
+			std::vector<GLuint>& indices = list_light_indices[list];
+			lights.clear();
+			indices.clear();
+			for (int i=first; i<last; i++) {
+				const scene_draw& d = scene_draws[scene_queue.items[i].draw];
+				lights.push_back(cull_lights_into(&scene_lights, d.center_W, d.light_radius, &indices));
+			}
+			record_light_indices(commands, indices);
+			for (int i=first; i<last; i++) {
+				const scene_draw& d = scene_draws[scene_queue.items[i].draw];
+				cmd_use_program(commands, d.program);
+				record_light_list(commands, lights[i - first]);
+				if (d.material >= 0) {
+					record_material(commands, &materials, d.material);
+				}
+				if (!d.instance_vbo) {
+					cmd_draw_batch(commands, d.batch, d.first, d.count);
+					continue;
+				}
+				// Same VAO as the batch; just the instance buffer differs.
+				const draw_arrays_command& object = d.batch->commands[d.first];
+				cmd_bind_vao(commands, static_format->vao);
+				cmd_bind_vertex_buffer(commands, static_format, STATIC_VERTEX_BINDING, d.batch->vbo, 0,
+									   sizeof(static_vertex));
+				cmd_bind_vertex_buffer(commands, static_format, STATIC_INSTANCE_BINDING, d.instance_vbo, 0,
+									   sizeof(m4));
+				if (bench_instances) {
+					cmd_begin_gpu_timer(commands, &instance_timer);
+				}
+				if (bench_instances && instance_phase == 0) {
+					for (int j=0; j<d.instances; j++) {
+						cmd_draw_arrays(commands, GL_TRIANGLES, object.first, object.count, 1, j);
+					}
+				}
+				else {
+					cmd_draw_arrays(commands, GL_TRIANGLES, object.first, object.count, d.instances, 0);
+				}
+				if (bench_instances) {
+					cmd_end_gpu_timer(commands, &instance_timer);
+				}
+			}
+		});
+		double record_sec = glfwGetTime() - submit_start;
+		record_ms += record_sec * 1000.0;
+		// Everything that depends on the camera goes in last: the camera
+		// block and the lights, which are in eye space.
+		if (pacer.late_latch) {
+			sample_input(window);
+		}
+		upload_uniform_block(&cam_ubo_block, &frame_uniforms);
+		upload_lights(&scene_lights, &frame_uniforms, world_lights ? NULL : &c_view_matrix);
+		flush_uniform_ring(&frame_uniforms);
+		bind_lights(&scene_lights, &frame_uniforms);
 
 		// Draw stuff, flip buffers.
-		glBindVertexArray(vao);
-		glDrawArrays(GL_TRIANGLES, 0, 3);
-		glBindVertexArray(vao2);
-		glDrawArrays(GL_TRIANGLES, 0, 3);
-		for (int i=0; i<6; i++) {
-			glBindVertexArray(plane_vaos[i]);
-			glDrawArrays(GL_TRIANGLES, 0, 6);
-		}
-		glBindVertexArray(mesh_vao);
-		glDrawArrays(GL_TRIANGLES, 0, num_vertices);
+		if (bench_lights) {
+			begin_gpu_timer(&bench_timer);
+		}
+		double replay_start = glfwGetTime();
+		for (int i=0; i<num_lists; i++) {
+			replay_command_list(&scene_lists[i], &frame_uniforms);
+		}
+		if (bench_instances) {
+			instance_ms += (record_sec + glfwGetTime() - replay_start) * 1000.0;
+		}
+		if (bench_instances) {
+			if (programs_building()) { instance_frame = 0; }
+			instance_frame++;
+			if (instance_frame == BENCH_WARMUP_FRAMES) {
+				reset_gpu_timer(&instance_timer);
+				instance_ms = 0.0;
+			}
+			else if (instance_frame == BENCH_WARMUP_FRAMES + BENCH_FRAMES) {
+				finish_gpu_timer(&instance_timer);
+				gl_log("Instance bench, %s: %i instances, %.3fms CPU submission/frame, %.3fms GPU/frame\n",
+					   instance_phase_names[instance_phase], num_instances,
+					   instance_ms / BENCH_FRAMES, gpu_ms_per_frame(&instance_timer));
+				reset_gpu_timer(&instance_timer);
+				instance_frame = 0;
+				instance_phase++;
+				if (instance_phase == 2) {
+					glfwSetWindowShouldClose(window, 1);
+				}
+			}
+		}
+		if (bench_batch) {
+			gl_use_program(textured);
+			// The lists left their own light indices bound.
+			bind_lights(&scene_lights, &frame_uniforms);
+			use_light_list(bench_lights_list);
+			double submit_start = glfwGetTime();
+			int calls = (batch_phase == 0) ?
+				draw_separate_vaos(&bench_objects, bench_vaos, 0, BENCH_BATCH_OBJECTS) :
+				draw_static_batch(&bench_objects, 0, BENCH_BATCH_OBJECTS);
+			double submit_ms = (glfwGetTime() - submit_start) * 1000.0;
+			// Don't count any frames drawn with the fallback.
+			if (programs_building()) { batch_frame = 0; }
+			batch_frame++;
+			if (batch_frame > BENCH_WARMUP_FRAMES) {
+				batch_ms += submit_ms;
+				batch_calls += calls;
+			}
+			if (batch_frame == BENCH_WARMUP_FRAMES + BENCH_FRAMES) {
+				gl_log("Batch bench, %s: %lu draw calls/frame, %.3fms CPU submission/frame\n",
+					   batch_phase_names[batch_phase], batch_calls / BENCH_FRAMES,
+					   batch_ms / BENCH_FRAMES);
+				batch_frame = 0;
+				batch_ms = 0.0;
+				batch_calls = 0;
+				batch_phase++;
+				if (batch_phase == 2 && !gl_caps.multi_draw_indirect) { batch_phase++; }
+				if (batch_phase == 3) {
+					glfwSetWindowShouldClose(window, 1);
+				}
+				else {
+					bench_objects.mode = (batch_phase == 1) ? BATCH_MULTI_DRAW : BATCH_MULTI_DRAW_INDIRECT;
+				}
+			}
+		}
+		if (bench_lights) {
+			end_gpu_timer(&bench_timer);
+			// Don't count any frames drawn with the fallback.
+			if (programs_building()) { bench_frame = 0; }
+			bench_frame++;
+			if (bench_frame == BENCH_WARMUP_FRAMES) {
+				reset_gpu_timer(&bench_timer);
+			}
+			else if (bench_frame == BENCH_WARMUP_FRAMES + BENCH_FRAMES) {
+				finish_gpu_timer(&bench_timer);
+				bench_ns[bench_phase] = gpu_ns_per_sample(&bench_timer);
+				gl_log("Lights bench, %s: %.3fms GPU/frame, %.4fns/sample, %llu samples/frame\n",
+					   bench_phase_names[bench_phase], gpu_ms_per_frame(&bench_timer),
+					   bench_ns[bench_phase], bench_timer.total_samples / bench_timer.frames);
+				reset_gpu_timer(&bench_timer);
+				bench_frame = 0;
+				bench_phase++;
+				if (bench_phase == 2) {
+					gl_log("Lights bench: %.1f%% less fragment time per sample\n",
+						   100.0 * (1.0 - bench_ns[1] / bench_ns[0]));
+					glfwSetWindowShouldClose(window, 1);
+				}
+			}
+		}
+		end_uniform_ring_frame(&frame_uniforms);
 		glfwSwapBuffers(window);
+		mark_frame_presented(&pacer);
+		total_frames++;
 	}
 
 	// Exit.
 	//gl_info();
+	gl_log("Command recording: %.3fms/frame on %i thread(s) over %lu frames\n",
+		   total_frames ? record_ms / total_frames : 0.0, (int)recorder.threads.size() + 1, total_frames);
+	log_stream_stats(&tex_streamer);
+	shutdown_texture_streamer(&tex_streamer);
+	if (use_materials) {
+		destroy_material_table(&materials);
+	}
+	if (hot_reload) {
+		shutdown_shader_watch(&shader_watcher);
+	}
+	destroy_command_recorder(&recorder);
+	destroy_static_batch(&scene_batch);
+	destroy_instance_buffer(&mesh_transforms);
+	if (bench_instances) {
+		destroy_gpu_timer(&instance_timer);
+	}
+	if (bench_batch) {
+		destroy_static_batch(&bench_objects);
+		for (unsigned int i=0; i<bench_vaos.size(); i++) {
+			gl_forget_vao(bench_vaos[i]);
+			gl_forget_buffer(bench_vbos[i]);
+		}
+		glDeleteVertexArrays(bench_vaos.size(), &bench_vaos[0]);
+		glDeleteBuffers(bench_vbos.size(), &bench_vbos[0]);
+	}
+	destroy_static_vertex_format();
+	log_frame_pacing(&pacer);
+	log_sim_clock(&sim);
+	destroy_frame_pacer(&pacer);
+	destroy_light_system(&scene_lights);
+	gl_log("Uniform ring: grew %lu time(s), %lu failed allocation(s)\n",
+		   frame_uniforms.grows, frame_uniforms.failed_allocs);
+	destroy_uniform_ring(&frame_uniforms);
+	log_stats logged = gl_log_stats();
+	gl_log("Log: %lu messages in %lu writes, %lu dropped\n",
+		   logged.messages, logged.writes, logged.dropped);
+	if (debug) {
+		log_gl_debug_stats();
+	}
+	log_gl_state_stats(total_frames);
+	if (bench_lights) {
+		destroy_gpu_timer(&bench_timer);
+	}
 	glfwTerminate();
 	return 0;
 }
@@ -749,7 +1030,7 @@ void glfw_win_resize(GLFWwindow* window, int w, int h) {
 	a_ratio = (float)w / (float)h;
 	
 	// Update the viewport.
-	glViewport(0, 0, g_win_w, g_win_h);
+	gl_viewport(0, 0, g_win_w, g_win_h);
 
 	// We should update the projection matrix next game loop step.
 	update_proj_matrix = true;
@@ -761,7 +1042,162 @@ void glfw_mouse_pos(GLFWwindow* window, double m_x, double m_y) {
 }
 
 void glfw_mouse_button(GLFWwindow* window, int button, int action, int mods) {
-	printf("MX: %.2f\nMY: %.2f\n", mouse_x, mouse_y);
+	log_trace(LOG_INPUT, "MX: %.2f\nMY: %.2f\n", mouse_x, mouse_y);
+}
+
+/*
+ * Input and simulation.
+ */
+// Polls input and runs the simulation steps that are due; the keys held
+// now steer every one of them.
+void sample_input(GLFWwindow* window) {
+	glfwPollEvents();
+	mark_input_sampled(&pacer);
+	// Escape = quit.
+	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
+		glfwSetWindowShouldClose(window, 1);
+	}
+
+	int steps = advance_sim_clock(&sim, glfwGetTime());
+	for (int i=0; i<steps; i++) {
+		step_camera(window, sim.step_sec);
+		update_lights(&scene_lights, sim.step_sec);
+	}
+	float alpha = sim_alpha(&sim);
+	interpolate_camera(alpha);
+	interpolate_lights(&scene_lights, alpha);
+}
+
+// One fixed step of camera movement.
+void step_camera(GLFWwindow* window, float step_sec) {
+	prev_cam_pos = cam_pos;
+	prev_cam_quat = cam_quat;
+	cam_yaw = cam_roll = cam_pitch = 0.0f;
+	c_move.v[0] = c_move.v[1] = c_move.v[2] = 0.0f;
+	bool cam_moved = false;
+
+	// Camera movement. First update vectors, then apply transformations.
+	// khjluo for rotation
+	if (glfwGetKey(window, GLFW_KEY_H)) {
+		cam_yaw -= cam_yaw_speed * step_sec;
+		cam_quat_yaw = set(cam_yaw, c_up);
+		cam_quat = cam_quat * cam_quat_yaw;
+		cam_rot = quaternion_to_rotation(cam_quat);
+		c_right = cam_rot.row(0);
+		c_up = cam_rot.row(1);
+		c_fwd = cam_rot.row(2) * -1.0f;
+		cam_moved = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_L)) {
+		cam_yaw += cam_yaw_speed * step_sec;
+		cam_quat_yaw = normalize(set(cam_yaw, c_up));
+		cam_quat = cam_quat * cam_quat_yaw;
+		cam_rot = quaternion_to_rotation(cam_quat);
+		c_right = cam_rot.row(0);
+		c_up = cam_rot.row(1);
+		c_fwd = cam_rot.row(2) * -1.0f;
+		cam_moved = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_K)) {
+		cam_pitch -= cam_pitch_speed * step_sec;
+		cam_quat_pitch = normalize(set(cam_pitch, c_right));
+		cam_quat = cam_quat * cam_quat_pitch;
+		cam_rot = quaternion_to_rotation(cam_quat);
+		c_right = cam_rot.row(0);
+		c_up = cam_rot.row(1);
+		c_fwd = cam_rot.row(2) * -1.0f;
+		cam_moved = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_J)) {
+		cam_pitch += cam_pitch_speed * step_sec;
+		cam_quat_pitch = normalize(set(cam_pitch, c_right));
+		cam_quat = cam_quat * cam_quat_pitch;
+		cam_rot = quaternion_to_rotation(cam_quat);
+		c_right = cam_rot.row(0);
+		c_up = cam_rot.row(1);
+		c_fwd = cam_rot.row(2) * -1.0f;
+		cam_moved = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_U)) {
+		cam_roll += cam_roll_speed * step_sec;
+		cam_quat_roll = normalize(set(cam_roll, c_fwd));
+		cam_quat = cam_quat * cam_quat_roll;
+		cam_rot = quaternion_to_rotation(cam_quat);
+		c_right = cam_rot.row(0);
+		c_up = cam_rot.row(1);
+		c_fwd = cam_rot.row(2) * -1.0f;
+		cam_moved = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_O)) {
+		cam_roll -= cam_roll_speed * step_sec;
+		cam_quat_roll = normalize(set(cam_roll, c_fwd));
+		cam_quat = cam_quat * cam_quat_roll;
+		cam_rot = quaternion_to_rotation(cam_quat);
+		c_right = cam_rot.row(0);
+		c_up = cam_rot.row(1);
+		c_fwd = cam_rot.row(2) * -1.0f;
+		cam_moved = true;
+	}
+	// wasd for movement.
+	if (glfwGetKey(window, GLFW_KEY_A)) {
+		c_move.v[0] += c_right.v[0] * cam_speed * step_sec;
+		c_move.v[1] += c_right.v[1] * cam_speed * step_sec;
+		c_move.v[2] += c_right.v[2] * cam_speed * step_sec;
+		cam_moved = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_D)) {
+		c_move.v[0] -= c_right.v[0] * cam_speed * step_sec;
+		c_move.v[1] -= c_right.v[1] * cam_speed * step_sec;
+		c_move.v[2] -= c_right.v[2] * cam_speed * step_sec;
+		cam_moved = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_W)) {
+		c_move.v[0] -= c_fwd.v[0] * cam_speed * step_sec;
+		c_move.v[1] -= c_fwd.v[1] * cam_speed * step_sec;
+		c_move.v[2] -= c_fwd.v[2] * cam_speed * step_sec;
+		cam_moved = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_S)) {
+		c_move.v[0] += c_fwd.v[0] * cam_speed * step_sec;
+		c_move.v[1] += c_fwd.v[1] * cam_speed * step_sec;
+		c_move.v[2] += c_fwd.v[2] * cam_speed * step_sec;
+		cam_moved = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_Q)) {
+		c_move.v[0] += c_up.v[0] * cam_speed * step_sec;
+		c_move.v[1] += c_up.v[1] * cam_speed * step_sec;
+		c_move.v[2] += c_up.v[2] * cam_speed * step_sec;
+		cam_moved = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_E)) {
+		c_move.v[0] -= c_up.v[0] * cam_speed * step_sec;
+		c_move.v[1] -= c_up.v[1] * cam_speed * step_sec;
+		c_move.v[2] -= c_up.v[2] * cam_speed * step_sec;
+		cam_moved = true;
+	}
+
+	// Updates based on camera movement.
+	if (cam_moved) {
+		log_trace(LOG_CAMERA, "CQ: %s\n", print(cam_quat).c_str());
+		cam_pos.v[0] += c_move.v[0];
+		cam_pos.v[1] += c_move.v[1];
+		cam_pos.v[2] += c_move.v[2];
+
+		log_debug(LOG_CAMERA, "Yaw:   %.2f\nRoll:  %.2f\nPitch: %.2f\n", cam_yaw, cam_roll, cam_pitch);
+		log_debug(LOG_CAMERA, "Up:    %s\nRight: %s\nFwd:   %s\n", print(c_up).c_str(), print(c_right).c_str(), print(c_fwd).c_str());
+		log_trace(LOG_CAMERA, "Rotation matrix:\n%s\n", print(quaternion_to_rotation(cam_quat)).c_str());
+	}
+}
+
+// The view drawn this frame, between where the camera was before the
+// last step and after it.
+void interpolate_camera(float alpha) {
+	v3 pos = lerp(prev_cam_pos, cam_pos, alpha);
+	m4 cam_trans = translation_matrix(pos.v[0], pos.v[1], pos.v[2]);
+	c_view_matrix = view_matrix(cam_trans, quaternion_to_rotation(slerp(prev_cam_quat, cam_quat, alpha)));
+	// Don't forget to tell the shaders.
+	cam_uniforms.V = transpose(c_view_matrix);
+	//glUniformMatrix4fv(view_matrix_loc, 1, GL_TRUE, c_view_matrix.m);
 }
 
 /*
@@ -776,9 +1212,117 @@ void update_fps_counter(GLFWwindow* window) {
 		prev_seconds = cur_seconds;
 		char tmp[128];
 		double fps = (double)frame_count / elapsed_seconds;
-		sprintf(tmp, "OpenGL - FPS: %.2f", fps);
+		sprintf(tmp, "OpenGL - FPS: %.2f, latency: %.1fms", fps, pacer.recent_ms);
 		glfwSetWindowTitle(window, tmp);
 		frame_count = 0;
 	}
 	frame_count ++;
 }
+
+/*
+ * Benchmarks.
+ */
+// An axis aligned cube, two triangles per face.
+void add_bench_cube(static_batch* batch, v3 center, float half_size) {
+	const float corners[6][2] = { {-1, -1}, {1, -1}, {1, 1}, {-1, -1}, {1, 1}, {-1, 1} };
+	GLfloat points[36*3], normals[36*3], texcoords[36*2];
+	int n = 0;
+	for (int face=0; face<6; face++) {
+		int axis = face / 2;
+		float side = (face % 2) ? 1.0f : -1.0f;
+		for (int c=0; c<6; c++, n++) {
+			float p[3];
+			p[axis] = side;
+			p[(axis + 1) % 3] = corners[c][0];
+			p[(axis + 2) % 3] = corners[c][1];
+			for (int k=0; k<3; k++) {
+				points[n*3 + k] = center.v[k] + p[k] * half_size;
+				normals[n*3 + k] = (k == axis) ? side : 0.0f;
+			}
+			texcoords[n*2] = corners[c][0] * 0.5f + 0.5f;
+			texcoords[n*2 + 1] = corners[c][1] * 0.5f + 0.5f;
+		}
+	}
+	add_static_mesh(batch, points, normals, texcoords, 36);
+}
+
+// 'count' copies of a mesh of the given radius on a grid filling a cube
+// of half-width 'extent', each scaled to fit its cell.
+void add_instance_grid(instance_buffer* instances, int count, float extent, float radius) {
+	int side = 1;
+	while (side * side * side < count) { side++; }
+	float cell = extent * 2.0f / side;
+	float scale = cell * 0.4f / radius;
+	for (int i=0; i<count; i++) {
+		float x = -extent + cell * (i % side + 0.5f);
+		float y = -extent + cell * ((i / side) % side + 0.5f);
+		float z = -extent + cell * (i / (side * side) + 0.5f);
+		add_instance(instances, translation_matrix(x, y, z) * scale_matrix(scale, scale, scale));
+	}
+}
+
+/*
+ * Texture LOD.
+ */
+// On-screen size in pixels the whole of a plane's texture would have
+// at the plane's nearest point to 'eye' (nearest point of its bounds,
+// exact for the room's axis-aligned planes). 0 if it faces away or is
+// past the far plane.
+float plane_footprint(const GLfloat* verts, int num_verts, const GLfloat* normal, v3 eye) {
+	v3 lo(verts[0], verts[1], verts[2]);
+	v3 hi = lo;
+	for (int i=1; i<num_verts; i++) {
+		for (int j=0; j<3; j++) {
+			if (verts[i*3+j] < lo.v[j]) { lo.v[j] = verts[i*3+j]; }
+			if (verts[i*3+j] > hi.v[j]) { hi.v[j] = verts[i*3+j]; }
+		}
+	}
+	float facing = 0.0f;
+	float extent = 0.0f;
+	v3 nearest;
+	for (int j=0; j<3; j++) {
+		facing += (eye.v[j] - verts[j]) * normal[j];
+		if (hi.v[j] - lo.v[j] > extent) { extent = hi.v[j] - lo.v[j]; }
+		nearest.v[j] = (eye.v[j] < lo.v[j]) ? lo.v[j] : (eye.v[j] > hi.v[j]) ? hi.v[j] : eye.v[j];
+	}
+	if (facing <= 0.0f) { return 0.0f; }
+	// Not screen_footprint(): that stops growing once we're inside the
+	// bounding sphere, but the texels right in front of us keep getting
+	// bigger the closer we get.
+	v3 to_plane = nearest - eye;
+	float distance = magnitude(to_plane);
+	if (distance > far) { return 0.0f; }
+	if (distance < near) { distance = near; }
+	return g_win_h * extent * 0.5f / (distance * tan(ang_to_rad(fov) * 0.5f));
+}
+
+// On-screen size of the nearest instance's bounding sphere, or about:
+// the nearest point of the instances' bounds stands in for the nearest
+// instance, which is never nearer, and the biggest scale for all of
+// them. 0 if they're past the far plane.
+float instances_footprint(const instance_buffer* instances, float radius, v3 eye) {
+	if (instances->transforms.empty()) { return 0.0f; }
+	v3 to_bounds;
+	for (int k=0; k<3; k++) {
+		float lo = instances->bounds_min.v[k];
+		float hi = instances->bounds_max.v[k];
+		float nearest = (eye.v[k] < lo) ? lo : (eye.v[k] > hi) ? hi : eye.v[k];
+		to_bounds.v[k] = nearest - eye.v[k];
+	}
+	float distance = magnitude(to_bounds);
+	float scaled = radius * instances->max_scale;
+	if (distance - scaled > far) { return 0.0f; }
+	return screen_footprint(scaled, distance, fov, g_win_h);
+}
+
+/*
+ * Render queue.
+ */
+void queue_scene_draw(render_queue* queue, std::vector<scene_draw>* draws, const scene_draw& draw, m4 view) {
+	v4 center_E = view * v4(draw.center_W, 1.0f);
+	// Every draw shares the static_vertex VAO for now.
+	GLuint vao = static_vertex_format()->vao;
+	uint64_t key = render_key(RENDER_PASS_OPAQUE, draw.program, draw.material + 1, vao, -center_E.v[2] / far);
+	submit_render_item(queue, key, draws->size());
+	draws->push_back(draw);
+}
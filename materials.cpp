@@ -0,0 +1,165 @@
+#include "materials.h"
+
+#include "glresource.h"
+#include "glstate.h"
+#include "texture.h"
+#include "util.h"
+
+static_assert(sizeof(gpu_material) == 32, "gpu_material must match the std430 layout in test.frag");
+
+static void set_sampling_params(GLenum target) {
+	glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	GLfloat max_anisotropic = 0.0f;
+	glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &max_anisotropic);
+	glTexParameterf(target, GL_TEXTURE_MAX_ANISOTROPY_EXT, max_anisotropic);
+}
+
+// Stands in for a texture that didn't load, so its material still gets
+// a valid handle. 1x1 magenta, hard to miss.
+static GLuint placeholder_texture() {
+	const unsigned char magenta[4] = { 255, 0, 255, 255 };
+	GLuint tex = create_texture_2d(1, GL_SRGB8_ALPHA8, 1, 1);
+	texture_sub_image_2d(tex, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, magenta);
+	return tex;
+}
+
+/*
+ * Bindless path: one ordinary 2D texture per material. Creating a handle
+ * freezes the texture's state, so it has to be fully loaded and
+ * configured first (which also rules out mip streaming for these).
+ */
+static int build_bindless(material_table* table, const char** texture_fns, int count) {
+	int failed = 0;
+	for (int i=0; i<count; i++) {
+		if (table->stream_handles[i] >= 0) { continue; }
+		GLuint tex = 0;
+		if (loadTexture(texture_fns[i], &tex) != 0) {
+			// What loadTexture hands back has no storage; no handle for that.
+			failed++;
+			gl_forget_texture(tex);
+			glDeleteTextures(1, &tex);
+			tex = placeholder_texture();
+			gl_bind_texture(GL_TEXTURE_2D, tex);
+		}
+		set_sampling_params(GL_TEXTURE_2D);
+
+		GLuint64 handle = glGetTextureHandleARB(tex);
+		glMakeTextureHandleResidentARB(handle);
+		table->textures.push_back(tex);
+		table->materials[i].handle = handle;
+	}
+	return failed;
+}
+
+// Fallback: every material packed into the layers of one array texture.
+static int build_array(material_table* table, const char** texture_fns, int count) {
+	std::vector<const char*> fns;
+	std::vector<int> packed;
+	for (int i=0; i<count; i++) {
+		if (table->stream_handles[i] >= 0) { continue; }
+		fns.push_back(texture_fns[i]);
+		packed.push_back(i);
+	}
+	if (fns.empty()) { return 0; }
+	int failed = build_texture_atlas(&fns[0], fns.size(), MATERIAL_ARRAY_SIZE,
+									 GL_TEXTURE_2D_ARRAY, &table->array);
+	set_sampling_params(GL_TEXTURE_2D_ARRAY);
+	for (unsigned int j=0; j<packed.size(); j++) {
+		const atlas_entry* e = &table->array.entries[j];
+		gpu_material* m = &table->materials[packed[j]];
+		m->layer = (float)e->layer;
+		m->uv_xform[0] = e->uv_offset[0];
+		m->uv_xform[1] = e->uv_offset[1];
+		m->uv_xform[2] = e->uv_scale[0];
+		m->uv_xform[3] = e->uv_scale[1];
+	}
+	return failed;
+}
+
+int build_material_table(material_table* table, const char** texture_fns, int count,
+						 texture_streamer* streamer) {
+	table->mode = gl_caps.bindless_texture ? MATERIAL_BINDLESS : MATERIAL_ARRAY;
+	table->textures.clear();
+	table->array.tex = 0;
+	table->materials.assign(count, gpu_material());
+	table->stream_handles.assign(count, -1);
+	table->stream_textures.assign(count, 0);
+	for (int i=0; i<count; i++) {
+		// Identity UV transform; only the array path changes it.
+		table->materials[i].uv_xform[2] = 1.0f;
+		table->materials[i].uv_xform[3] = 1.0f;
+	}
+
+	// Anything with a cooked twin streams; the rest goes in the table.
+	int streamed = 0;
+	for (int i=0; streamer && i<count; i++) {
+		GLuint tex = 0;
+		int handle = stream_texture(streamer, texture_fns[i], &tex);
+		if (handle < 0) { continue; }
+		gl_active_texture(GL_TEXTURE0 + MATERIAL_STREAM_UNIT);
+		gl_bind_texture(GL_TEXTURE_2D, tex);
+		set_sampling_params(GL_TEXTURE_2D);
+		table->stream_handles[i] = handle;
+		table->stream_textures[i] = tex;
+		table->materials[i].layer = -1.0f;
+		streamed++;
+	}
+
+	gl_active_texture(GL_TEXTURE0 + MATERIAL_ARRAY_UNIT);
+	int failed = (table->mode == MATERIAL_BINDLESS) ?
+		build_bindless(table, texture_fns, count) :
+		build_array(table, texture_fns, count);
+
+	table->ssbo = create_buffer(sizeof(gpu_material) * count, &table->materials[0], 0);
+
+	gl_log("Material table: %i materials, %s, %i streamed\n", count,
+		   (table->mode == MATERIAL_BINDLESS) ? "bindless handles" : "texture array fallback",
+		   streamed);
+	return failed ? 1 : 0;
+}
+
+const char* material_shader_define(const material_table* table) {
+	return (table->mode == MATERIAL_BINDLESS) ? "MATERIALS_BINDLESS" : "MATERIALS_ARRAY";
+}
+
+int material_stream_handle(const material_table* table, int material) {
+	return table->stream_handles[material];
+}
+
+void record_material(command_list* list, const material_table* table, int material) {
+	cmd_bind_buffer_base(list, GL_SHADER_STORAGE_BUFFER, MATERIAL_SSBO_BINDING, table->ssbo);
+	if (table->mode == MATERIAL_ARRAY && table->array.tex) {
+		cmd_bind_texture(list, GL_TEXTURE0 + MATERIAL_ARRAY_UNIT, GL_TEXTURE_2D_ARRAY, table->array.tex);
+	}
+	if (table->stream_textures[material]) {
+		cmd_bind_texture(list, GL_TEXTURE0 + MATERIAL_STREAM_UNIT, GL_TEXTURE_2D,
+						 table->stream_textures[material]);
+	}
+	cmd_uniform_1i(list, MATERIAL_INDEX_LOCATION, material);
+}
+
+void destroy_material_table(material_table* table) {
+	for (unsigned int i=0; i<table->materials.size(); i++) {
+		if (table->mode == MATERIAL_BINDLESS && table->materials[i].handle) {
+			glMakeTextureHandleNonResidentARB(table->materials[i].handle);
+		}
+	}
+	for (unsigned int i=0; i<table->textures.size(); i++) {
+		gl_forget_texture(table->textures[i]);
+	}
+	if (!table->textures.empty()) {
+		glDeleteTextures(table->textures.size(), &table->textures[0]);
+	}
+	if (table->array.tex) {
+		gl_forget_texture(table->array.tex);
+		glDeleteTextures(1, &table->array.tex);
+	}
+	delete_buffer(&table->ssbo);
+	table->textures.clear();
+	table->materials.clear();
+	table->stream_handles.clear();
+	table->stream_textures.clear();
+}
@@ -0,0 +1,71 @@
+#ifndef KESHI_MATERIALS
+#define KESHI_MATERIALS
+
+#include <GL/glew.h>
+
+#include <vector>
+
+#include "atlas.h"
+#include "commands.h"
+#include "texstream.h"
+
+#define MATERIAL_BINDLESS 0
+#define MATERIAL_ARRAY 1
+
+// Shader storage binding of the material table and the explicit
+// location of its 'material_index' uniform (see test.frag).
+#define MATERIAL_SSBO_BINDING 2
+#define MATERIAL_INDEX_LOCATION 0
+// Texture unit the array fallback lives on.
+#define MATERIAL_ARRAY_UNIT 0
+// Page size for the texture array fallback.
+#define MATERIAL_ARRAY_SIZE 1024
+// Texture unit for materials that stream their mips.
+#define MATERIAL_STREAM_UNIT 1
+
+/*
+ * One entry of the material SSBO (std430, 32 bytes).
+ * Bindless: 'handle' is a resident texture handle.
+ * Array fallback: sample 'layer' at uv * uv_xform.zw + uv_xform.xy.
+ * Either way, a negative 'layer' means the texture streams, and it's an
+ * ordinary texture bound at MATERIAL_STREAM_UNIT.
+ */
+struct gpu_material {
+	GLuint64 handle;
+	float layer;
+	float pad;
+	float uv_xform[4];
+};
+
+/*
+ * Every material's texture, reachable from a shader through one SSBO
+ * indexed by 'material_index', so switching materials between draws
+ * is a glUniform1i(MATERIAL_INDEX_LOCATION, i) instead of a glBindTexture.
+ * The exception is cooked (.ktex) textures: they stream their mips in
+ * (texstream.h), which a bindless handle would freeze and an array
+ * layer can't do alone, so those stay separate textures bound per draw.
+ */
+struct material_table {
+	int mode;
+	GLuint ssbo;
+	std::vector<GLuint> textures;
+	texture_atlas array;
+	std::vector<gpu_material> materials;
+	// Per material: streamer handle and texture, or -1 and 0. The
+	// streamer owns the textures.
+	std::vector<int> stream_handles;
+	std::vector<GLuint> stream_textures;
+};
+
+// 'streamer' may be NULL to load everything whole.
+int build_material_table(material_table* table, const char** texture_fns, int count,
+						 texture_streamer* streamer);
+// Shader define selecting this table's sampling path.
+const char* material_shader_define(const material_table* table);
+// For request_texture_lod(); -1 if the material doesn't stream.
+int material_stream_handle(const material_table* table, int material);
+// Records the table's binds and selects 'material' for the draws after it.
+void record_material(command_list* list, const material_table* table, int material);
+void destroy_material_table(material_table* table);
+
+#endif
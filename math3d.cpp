@@ -483,6 +483,14 @@ m4 translation_matrix(float x, float y, float z) {
 	return translation;
 }
 
+m4 scale_matrix(float x, float y, float z) {
+	m4 scale(x, 0, 0, 0,
+			 0, y, 0, 0,
+			 0, 0, z, 0,
+			 0, 0, 0, 1);
+	return scale;
+}
+
 /*
  * Create a rotation matrix from a quaternion.
  */
@@ -659,12 +667,13 @@ quat slerp(quat q1, quat q2, float prog) {
 	quat result;
 	float d = dot(q1, q2);
 
-	// Negate one of the quats if we want to take the longer
-	// rounded path.
+	// q and -q are the same rotation; flip one so we take the shorter
+	// path around.
 	if (d < 0.0f) {
 		for (int i=0; i<4; i++) {
 			q1.q[i] *= -1.0f;
 		}
+		d = -d;
 	}
 
 	if (fabs(d) >= 1.0f && fabs(d) <= 1.001f) {
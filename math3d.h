@@ -132,6 +132,7 @@ m4 rotate_y_rads(float rads);
 m4 rotate_z(float degrees);
 m4 rotate_z_rads(float rads);
 m4 translation_matrix(float x, float y, float z);
+m4 scale_matrix(float x, float y, float z);
 m4 quaternion_to_rotation(quat q);
 m4 view_matrix(m4 translation, m4 rotation);
 m4 look_at(v3 pos, v3 t_pos, v3 up);
@@ -0,0 +1,249 @@
+#include "qoi.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF  0x40
+#define QOI_OP_LUMA  0x80
+#define QOI_OP_RUN   0xc0
+#define QOI_OP_RGB   0xfe
+#define QOI_OP_RGBA  0xff
+#define QOI_MASK_2   0xc0
+#define QOI_PADDING  8
+// Refuse anything over 400 megapixels, like the reference implementation.
+#define QOI_PIXELS_MAX 400000000
+
+struct qoi_rgba {
+	unsigned char r, g, b, a;
+};
+
+static inline int qoi_hash(qoi_rgba c) {
+	return (c.r*3 + c.g*5 + c.b*7 + c.a*11) % 64;
+}
+
+static inline unsigned int read_u32(const unsigned char* p) {
+	return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static inline void write_u32(unsigned char* p, unsigned int v) {
+	p[0] = (v >> 24) & 0xff;
+	p[1] = (v >> 16) & 0xff;
+	p[2] = (v >> 8) & 0xff;
+	p[3] = v & 0xff;
+}
+
+unsigned char* qoi_decode(const unsigned char* data, int size,
+						  int* x, int* y, int* channels, int req_channels) {
+	if (size < QOI_HEADER_SIZE + QOI_PADDING || memcmp(data, "qoif", 4) != 0) {
+		return NULL;
+	}
+	unsigned int w = read_u32(data + 4);
+	unsigned int h = read_u32(data + 8);
+	int file_channels = data[12];
+	if (w == 0 || h == 0 || (file_channels != 3 && file_channels != 4) ||
+		h >= QOI_PIXELS_MAX / w) {
+		return NULL;
+	}
+	int out_channels = req_channels ? req_channels : file_channels;
+	if (out_channels != 3 && out_channels != 4) { return NULL; }
+
+	unsigned long px_len = (unsigned long)w * h * out_channels;
+	unsigned char* pixels = (unsigned char*)malloc(px_len);
+	if (!pixels) { return NULL; }
+
+	qoi_rgba index[64];
+	memset(index, 0, sizeof(index));
+	qoi_rgba px = { 0, 0, 0, 255 };
+	int run = 0;
+	int p = QOI_HEADER_SIZE;
+	int chunks_end = size - QOI_PADDING;
+
+	for (unsigned long px_pos = 0; px_pos < px_len; px_pos += out_channels) {
+		if (run > 0) {
+			run--;
+		}
+		else if (p < chunks_end) {
+			int b1 = data[p++];
+			if (b1 == QOI_OP_RGB) {
+				px.r = data[p++];
+				px.g = data[p++];
+				px.b = data[p++];
+			}
+			else if (b1 == QOI_OP_RGBA) {
+				px.r = data[p++];
+				px.g = data[p++];
+				px.b = data[p++];
+				px.a = data[p++];
+			}
+			else if ((b1 & QOI_MASK_2) == QOI_OP_INDEX) {
+				px = index[b1];
+			}
+			else if ((b1 & QOI_MASK_2) == QOI_OP_DIFF) {
+				px.r += ((b1 >> 4) & 0x03) - 2;
+				px.g += ((b1 >> 2) & 0x03) - 2;
+				px.b += ( b1       & 0x03) - 2;
+			}
+			else if ((b1 & QOI_MASK_2) == QOI_OP_LUMA) {
+				int b2 = data[p++];
+				int vg = (b1 & 0x3f) - 32;
+				px.r += vg - 8 + ((b2 >> 4) & 0x0f);
+				px.g += vg;
+				px.b += vg - 8 +  (b2       & 0x0f);
+			}
+			else {
+				run = (b1 & 0x3f);
+			}
+			index[qoi_hash(px)] = px;
+		}
+
+		pixels[px_pos]   = px.r;
+		pixels[px_pos+1] = px.g;
+		pixels[px_pos+2] = px.b;
+		if (out_channels == 4) {
+			pixels[px_pos+3] = px.a;
+		}
+	}
+
+	*x = w;
+	*y = h;
+	if (channels) { *channels = file_channels; }
+	return pixels;
+}
+
+unsigned char* qoi_encode(const unsigned char* pixels, int x, int y,
+						  int channels, int* out_len) {
+	if (x <= 0 || y <= 0 || (channels != 3 && channels != 4) ||
+		y >= QOI_PIXELS_MAX / x) {
+		return NULL;
+	}
+
+	// Worst case is one RGBA op per pixel.
+	unsigned long max_size = (unsigned long)x * y * (channels + 1) +
+							 QOI_HEADER_SIZE + QOI_PADDING;
+	unsigned char* bytes = (unsigned char*)malloc(max_size);
+	if (!bytes) { return NULL; }
+
+	memcpy(bytes, "qoif", 4);
+	write_u32(bytes + 4, x);
+	write_u32(bytes + 8, y);
+	bytes[12] = channels;
+	bytes[13] = QOI_SRGB;
+	int p = QOI_HEADER_SIZE;
+
+	qoi_rgba index[64];
+	memset(index, 0, sizeof(index));
+	qoi_rgba px_prev = { 0, 0, 0, 255 };
+	qoi_rgba px = px_prev;
+	int run = 0;
+	unsigned long px_len = (unsigned long)x * y * channels;
+	unsigned long px_end = px_len - channels;
+
+	for (unsigned long px_pos = 0; px_pos < px_len; px_pos += channels) {
+		px.r = pixels[px_pos];
+		px.g = pixels[px_pos+1];
+		px.b = pixels[px_pos+2];
+		if (channels == 4) { px.a = pixels[px_pos+3]; }
+
+		if (memcmp(&px, &px_prev, 4) == 0) {
+			run++;
+			if (run == 62 || px_pos == px_end) {
+				bytes[p++] = QOI_OP_RUN | (run - 1);
+				run = 0;
+			}
+		}
+		else {
+			if (run > 0) {
+				bytes[p++] = QOI_OP_RUN | (run - 1);
+				run = 0;
+			}
+
+			int index_pos = qoi_hash(px);
+			if (memcmp(&index[index_pos], &px, 4) == 0) {
+				bytes[p++] = QOI_OP_INDEX | index_pos;
+			}
+			else {
+				index[index_pos] = px;
+				if (px.a == px_prev.a) {
+					signed char vr = px.r - px_prev.r;
+					signed char vg = px.g - px_prev.g;
+					signed char vb = px.b - px_prev.b;
+					signed char vg_r = vr - vg;
+					signed char vg_b = vb - vg;
+
+					if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+						bytes[p++] = QOI_OP_DIFF | ((vr + 2) << 4) | ((vg + 2) << 2) | (vb + 2);
+					}
+					else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 &&
+							 vg_b > -9 && vg_b < 8) {
+						bytes[p++] = QOI_OP_LUMA | (vg + 32);
+						bytes[p++] = ((vg_r + 8) << 4) | (vg_b + 8);
+					}
+					else {
+						bytes[p++] = QOI_OP_RGB;
+						bytes[p++] = px.r;
+						bytes[p++] = px.g;
+						bytes[p++] = px.b;
+					}
+				}
+				else {
+					bytes[p++] = QOI_OP_RGBA;
+					bytes[p++] = px.r;
+					bytes[p++] = px.g;
+					bytes[p++] = px.b;
+					bytes[p++] = px.a;
+				}
+			}
+		}
+		px_prev = px;
+	}
+
+	// End marker: seven 0x00 bytes then 0x01.
+	memset(bytes + p, 0, QOI_PADDING - 1);
+	p += QOI_PADDING - 1;
+	bytes[p++] = 1;
+
+	*out_len = p;
+	return bytes;
+}
+
+unsigned char* qoi_read(const char* filename, int* x, int* y, int* channels, int req_channels) {
+	FILE* file = fopen(filename, "rb");
+	if (!file) { return NULL; }
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	if (size <= 0) {
+		fclose(file);
+		return NULL;
+	}
+
+	unsigned char* data = (unsigned char*)malloc(size);
+	size_t read = data ? fread(data, 1, size, file) : 0;
+	fclose(file);
+	if (read != (size_t)size) {
+		free(data);
+		return NULL;
+	}
+
+	unsigned char* pixels = qoi_decode(data, size, x, y, channels, req_channels);
+	free(data);
+	return pixels;
+}
+
+int qoi_write(const char* filename, const unsigned char* pixels, int x, int y, int channels) {
+	int len = 0;
+	unsigned char* encoded = qoi_encode(pixels, x, y, channels, &len);
+	if (!encoded) { return 1; }
+
+	FILE* file = fopen(filename, "wb");
+	if (!file) {
+		free(encoded);
+		return 1;
+	}
+	size_t written = fwrite(encoded, 1, len, file);
+	fclose(file);
+	free(encoded);
+	return (written == (size_t)len) ? 0 : 1;
+}
@@ -0,0 +1,23 @@
+#ifndef KESHI_QOI
+#define KESHI_QOI
+
+/*
+ * "Quite OK Image" format: lossless, byte-oriented, and much faster to
+ * decode than PNG since there is no entropy coding to unwind.
+ * https://qoiformat.org/qoi-specification.pdf
+ * Pixel buffers are malloc'd; release them with free().
+ */
+#define QOI_HEADER_SIZE 14
+#define QOI_SRGB 0
+#define QOI_LINEAR 1
+
+// req_channels is 3, 4, or 0 to keep the file's channel count.
+unsigned char* qoi_decode(const unsigned char* data, int size,
+						  int* x, int* y, int* channels, int req_channels);
+unsigned char* qoi_encode(const unsigned char* pixels, int x, int y,
+						  int channels, int* out_len);
+
+unsigned char* qoi_read(const char* filename, int* x, int* y, int* channels, int req_channels);
+int qoi_write(const char* filename, const unsigned char* pixels, int x, int y, int channels);
+
+#endif
@@ -0,0 +1,103 @@
+#include "renderqueue.h"
+
+#include <stddef.h>
+
+#define DEPTH_SHIFT 0
+#define VAO_SHIFT (DEPTH_SHIFT + RENDER_KEY_DEPTH_BITS)
+#define MATERIAL_SHIFT (VAO_SHIFT + RENDER_KEY_VAO_BITS)
+#define PROGRAM_SHIFT (MATERIAL_SHIFT + RENDER_KEY_MATERIAL_BITS)
+#define PASS_SHIFT (PROGRAM_SHIFT + RENDER_KEY_PROGRAM_BITS)
+
+static_assert(PASS_SHIFT + RENDER_KEY_PASS_BITS == 64, "render key fields must fill 64 bits");
+
+// 11-bit digits: six passes over 64 bits, and the counts stay in L1.
+#define RADIX_BITS 11
+#define RADIX_SIZE (1 << RADIX_BITS)
+#define RADIX_PASSES ((64 + RADIX_BITS - 1) / RADIX_BITS)
+
+static inline uint64_t field(unsigned int value, int bits, int shift) {
+	return ((uint64_t)value & ((1ull << bits) - 1)) << shift;
+}
+
+static inline unsigned int get_field(uint64_t key, int bits, int shift) {
+	return (unsigned int)((key >> shift) & ((1ull << bits) - 1));
+}
+
+uint64_t render_key(unsigned int pass, unsigned int program, unsigned int material,
+					unsigned int vao, float depth) {
+	if (!(depth > 0.0f)) { depth = 0.0f; }
+	if (depth > 1.0f) { depth = 1.0f; }
+	unsigned int max_depth = (1u << RENDER_KEY_DEPTH_BITS) - 1;
+	unsigned int z = (unsigned int)(depth * max_depth);
+	return field(pass, RENDER_KEY_PASS_BITS, PASS_SHIFT) |
+		field(program, RENDER_KEY_PROGRAM_BITS, PROGRAM_SHIFT) |
+		field(material, RENDER_KEY_MATERIAL_BITS, MATERIAL_SHIFT) |
+		field(vao, RENDER_KEY_VAO_BITS, VAO_SHIFT) |
+		field(z, RENDER_KEY_DEPTH_BITS, DEPTH_SHIFT);
+}
+
+unsigned int render_key_pass(uint64_t key) {
+	return get_field(key, RENDER_KEY_PASS_BITS, PASS_SHIFT);
+}
+
+unsigned int render_key_program(uint64_t key) {
+	return get_field(key, RENDER_KEY_PROGRAM_BITS, PROGRAM_SHIFT);
+}
+
+unsigned int render_key_material(uint64_t key) {
+	return get_field(key, RENDER_KEY_MATERIAL_BITS, MATERIAL_SHIFT);
+}
+
+unsigned int render_key_vao(uint64_t key) {
+	return get_field(key, RENDER_KEY_VAO_BITS, VAO_SHIFT);
+}
+
+void clear_render_queue(render_queue* queue) {
+	queue->items.clear();
+}
+
+void submit_render_item(render_queue* queue, uint64_t key, uint32_t draw) {
+	render_item item = { key, draw };
+	queue->items.push_back(item);
+}
+
+void sort_render_queue(render_queue* queue) {
+	size_t n = queue->items.size();
+	if (n < 2) { return; }
+	queue->scratch.resize(n);
+
+	// Every digit's counts in one read, up front.
+	queue->counts.assign(RADIX_PASSES * RADIX_SIZE, 0);
+	uint32_t* counts = &queue->counts[0];
+	const render_item* items = &queue->items[0];
+	for (size_t i=0; i<n; i++) {
+		uint64_t key = items[i].key;
+		for (int p=0; p<RADIX_PASSES; p++) {
+			counts[p * RADIX_SIZE + ((key >> (p * RADIX_BITS)) & (RADIX_SIZE - 1))]++;
+		}
+	}
+
+	render_item* src = &queue->items[0];
+	render_item* dst = &queue->scratch[0];
+	for (int p=0; p<RADIX_PASSES; p++) {
+		int shift = p * RADIX_BITS;
+		// Nothing to do if every key has the same digit here.
+		const uint32_t* digit_counts = counts + p * RADIX_SIZE;
+		if (digit_counts[(src[0].key >> shift) & (RADIX_SIZE - 1)] == n) { continue; }
+		uint32_t offsets[RADIX_SIZE];
+		uint32_t sum = 0;
+		for (int d=0; d<RADIX_SIZE; d++) {
+			offsets[d] = sum;
+			sum += digit_counts[d];
+		}
+		for (size_t i=0; i<n; i++) {
+			dst[offsets[(src[i].key >> shift) & (RADIX_SIZE - 1)]++] = src[i];
+		}
+		render_item* tmp = src;
+		src = dst;
+		dst = tmp;
+	}
+	if (src != &queue->items[0]) {
+		queue->items.swap(queue->scratch);
+	}
+}
@@ -0,0 +1,54 @@
+#ifndef KESHI_RENDERQUEUE
+#define KESHI_RENDERQUEUE
+
+#include <stdint.h>
+
+#include <vector>
+
+// Sort key layout, most significant first. Widths add up to 64.
+#define RENDER_KEY_PASS_BITS 4
+#define RENDER_KEY_PROGRAM_BITS 10
+#define RENDER_KEY_MATERIAL_BITS 14
+#define RENDER_KEY_VAO_BITS 12
+#define RENDER_KEY_DEPTH_BITS 24
+
+// Passes draw in this order. Opaque is sorted front to back; a blended
+// pass would want the depth flipped.
+#define RENDER_PASS_OPAQUE 0
+
+// One draw: the key to sort on and which of the caller's draws it is.
+struct render_item {
+	uint64_t key;
+	uint32_t draw;
+};
+
+/*
+ * Draws sorted by a 64-bit key: pass, then program, material and VAO,
+ * so state changes come in runs (and the GL state cache drops the
+ * repeats), then quantized depth, so within a run the nearest things
+ * draw first and the rest gets rejected by early Z.
+ * Fields that don't fit their bits are masked, which only costs
+ * grouping, never correctness. The sort is an LSD radix sort, stable,
+ * and skips any digit that's the same in every key.
+ * Each frame: clear, submit everything, sort, then draw items in order.
+ */
+struct render_queue {
+	std::vector<render_item> items;
+	// Ping-pong buffer and digit counts for the sort.
+	std::vector<render_item> scratch;
+	std::vector<uint32_t> counts;
+};
+
+// 'depth' is view distance over the far plane; it's clamped to [0, 1].
+uint64_t render_key(unsigned int pass, unsigned int program, unsigned int material,
+					unsigned int vao, float depth);
+unsigned int render_key_pass(uint64_t key);
+unsigned int render_key_program(uint64_t key);
+unsigned int render_key_material(uint64_t key);
+unsigned int render_key_vao(uint64_t key);
+
+void clear_render_queue(render_queue* queue);
+void submit_render_item(render_queue* queue, uint64_t key, uint32_t draw);
+void sort_render_queue(render_queue* queue);
+
+#endif
@@ -0,0 +1,567 @@
+#include "shader.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+#include "glstate.h"
+#include "util.h"
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+program_cache_stats program_cache;
+
+// Permutation cache.
+static std::vector<shader_program> programs;
+static std::map<std::string, int> program_handles;
+// Calls to update_programs() so far; builds note which one they were
+// issued before.
+static unsigned long program_frame = 0;
+
+typedef std::chrono::steady_clock shader_clock;
+
+static double ms_since(shader_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(shader_clock::now() - start).count();
+}
+
+/*
+ * FNV-1a; plenty for cache keys.
+ */
+uint64_t hash_bytes(const void* data, unsigned long len, uint64_t hash) {
+	const unsigned char* p = (const unsigned char*)data;
+	for (unsigned long i=0; i<len; i++) {
+		hash ^= p[i];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+uint64_t hash_string(const char* str, uint64_t hash) {
+	// Include the terminator so "ab"+"c" and "a"+"bc" differ.
+	return hash_bytes(str, strlen(str) + 1, hash);
+}
+
+static uint64_t driver_hash() {
+	static uint64_t hash = 0;
+	if (!hash) {
+		hash = FNV_OFFSET;
+		hash = hash_string((const char*)glGetString(GL_VENDOR), hash);
+		hash = hash_string((const char*)glGetString(GL_RENDERER), hash);
+		hash = hash_string((const char*)glGetString(GL_VERSION), hash);
+	}
+	return hash;
+}
+
+static void cache_path(uint64_t key, char* out, int out_len) {
+	snprintf(out, out_len, "%s%016llx.bin", PROGRAM_CACHE_DIR, (unsigned long long)key);
+}
+
+static bool cache_supported() {
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
+}
+
+/*
+ * Defines.
+ */
+void define(shader_defines* defines, const char* name) {
+	defines->values[name] = "";
+}
+
+void define(shader_defines* defines, const char* name, int value) {
+	defines->values[name] = std::to_string(value);
+}
+
+std::string define_block(const shader_defines* defines) {
+	std::string block;
+	std::map<std::string, std::string>::const_iterator it;
+	for (it = defines->values.begin(); it != defines->values.end(); ++it) {
+		block += "#define " + it->first;
+		if (!it->second.empty()) { block += " " + it->second; }
+		block += "\n";
+	}
+	return block;
+}
+
+/*
+ * Preprocessing.
+ * GL doesn't do #include, so it's resolved here. Each included file is
+ * wrapped in #line directives whose source string number is its index
+ * in 'deps', so compile errors still point at the right file and line.
+ */
+static bool read_text(const std::string& filename, std::string* out) {
+	std::ifstream file(filename.c_str(), std::ios::in);
+	if (!file) { return false; }
+	std::stringstream contents;
+	contents << file.rdbuf();
+	*out = contents.str();
+	return true;
+}
+
+static std::string dir_of(const std::string& path) {
+	size_t slash = path.rfind('/');
+	return (slash == std::string::npos) ? "" : path.substr(0, slash + 1);
+}
+
+// Name from '#include "name"' or '#include <name>', or "" if not an include.
+static std::string include_name(const std::string& line) {
+	size_t start = line.find_first_not_of(" \t");
+	if (start == std::string::npos || line.compare(start, 8, "#include") != 0) {
+		return "";
+	}
+	size_t open = line.find_first_of("\"<", start + 8);
+	if (open == std::string::npos) { return ""; }
+	size_t close = line.find_first_of("\">", open + 1);
+	if (close == std::string::npos) { return ""; }
+	return line.substr(open + 1, close - open - 1);
+}
+
+static int include_file(const std::string& filename, int depth,
+						std::string* out, std::vector<std::string>* deps) {
+	// Each file goes in once per shader, like an implicit #pragma once.
+	for (unsigned int i=0; i<deps->size(); i++) {
+		if ((*deps)[i] == filename) { return 0; }
+	}
+	if (depth > SHADER_MAX_INCLUDE_DEPTH) {
+		gl_log_error("ERROR: shader includes nested too deeply at %s\n", filename.c_str());
+		return 1;
+	}
+	std::string text;
+	if (!read_text(filename, &text)) {
+		gl_log_error("ERROR: Could not read shader %s\n", filename.c_str());
+		// Still a dependency: creating it should trigger a rebuild.
+		deps->push_back(filename);
+		return 1;
+	}
+	deps->push_back(filename);
+	int file_index = deps->size() - 1;
+	if (depth > 0) {
+		*out += "#line 1 " + std::to_string(file_index) + "\n";
+	}
+
+	int failed = 0;
+	int line_num = 0;
+	std::istringstream lines(text);
+	std::string line;
+	while (std::getline(lines, line)) {
+		line_num++;
+		std::string name = include_name(line);
+		if (name.empty()) {
+			*out += line + "\n";
+			continue;
+		}
+
+		// Next to the includer first, then the shared include directory.
+		std::string path = dir_of(filename) + name;
+		std::ifstream probe(path.c_str());
+		if (!probe) { path = SHADER_INCLUDE_DIR + name; }
+		failed += include_file(path, depth + 1, out, deps);
+		*out += "#line " + std::to_string(line_num + 1) + " " + std::to_string(file_index) + "\n";
+	}
+	return failed;
+}
+
+int preprocessShader(const char* filename, const char* defines,
+					 std::string* source, std::vector<std::string>* deps) {
+	std::vector<std::string> files;
+	source->clear();
+	int failed = include_file(filename, 0, source, &files);
+	deps->insert(deps->end(), files.begin(), files.end());
+	if (failed) { return failed; }
+
+	// #version has to stay first, so splice the defines in after it.
+	size_t insert_at = 0;
+	int version_lines = 0;
+	if (source->compare(0, 8, "#version") == 0) {
+		size_t eol = source->find('\n');
+		insert_at = (eol == std::string::npos) ? source->size() : eol + 1;
+		version_lines = 1;
+	}
+	std::string block = defines;
+	block += "#line " + std::to_string(version_lines + 1) + " 0\n";
+	source->insert(insert_at, block);
+	return 0;
+}
+
+// Checks (and logs) link status; blocks until linking is done.
+bool programLinked(GLuint program, const char* name) {
+	int params = -1;
+	glGetProgramiv(program, GL_LINK_STATUS, &params);
+	if (GL_TRUE != params) {
+		gl_log_error("(%i) Error in shader linking: %s\n", program, name);
+		int actual_length = 0;
+		char log[GL_SHADER_LOG_LEN];
+		glGetProgramInfoLog(program, GL_SHADER_LOG_LEN, &actual_length, log);
+		gl_log("Shader log:\n---\n%s---\n", log);
+		return false;
+	}
+	return true;
+}
+
+static bool shader_compiled(GLuint shader, const char* name) {
+	int params = -1;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &params);
+	if (GL_TRUE != params) {
+		gl_log_error("ERROR: GL shader '%s'(%i) did not compile\n", name, shader);
+		int actual_length = 0;
+		char log[GL_SHADER_LOG_LEN];
+		glGetShaderInfoLog(shader, GL_SHADER_LOG_LEN, &actual_length, log);
+		gl_log("Shader info log for '%s'(%i):\n---\n%s\n---\n", name, shader, log);
+		return false;
+	}
+	return true;
+}
+
+// Returns a linked program, or 0 on a miss.
+static GLuint load_cached_program(uint64_t key, double* compile_ms) {
+	char fn[256];
+	cache_path(key, fn, sizeof(fn));
+	FILE* file = fopen(fn, "rb");
+	if (!file) { return 0; }
+
+	program_cache_header header;
+	std::vector<char> binary;
+	bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+			  memcmp(header.magic, PROGRAM_CACHE_MAGIC, 4) == 0 &&
+			  header.version == PROGRAM_CACHE_VERSION &&
+			  header.key == key && header.binary_length > 0;
+	if (ok) {
+		binary.resize(header.binary_length);
+		ok = fread(&binary[0], 1, binary.size(), file) == binary.size();
+	}
+	fclose(file);
+	if (!ok) { return 0; }
+
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, header.binary_format, &binary[0], header.binary_length);
+	GLint status = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (status != GL_TRUE) {
+		// Driver changed its mind about the format; rebuild.
+		glDeleteProgram(program);
+		return 0;
+	}
+	*compile_ms = header.compile_ms;
+	return program;
+}
+
+static void save_cached_program(GLuint program, uint64_t key, double compile_ms) {
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) { return; }
+
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(program, length, NULL, &format, &binary[0]);
+
+	program_cache_header header;
+	memcpy(header.magic, PROGRAM_CACHE_MAGIC, 4);
+	header.version = PROGRAM_CACHE_VERSION;
+	header.key = key;
+	header.binary_format = format;
+	header.binary_length = length;
+	header.compile_ms = compile_ms;
+
+	mkdir(PROGRAM_CACHE_DIR, 0755);
+	char fn[256];
+	cache_path(key, fn, sizeof(fn));
+	FILE* file = fopen(fn, "wb");
+	if (!file) {
+		gl_log("WARN:  couldn't write program cache %s\n", fn);
+		return;
+	}
+	fwrite(&header, sizeof(header), 1, file);
+	fwrite(&binary[0], 1, length, file);
+	fclose(file);
+}
+
+static void log_source_strings(const char* filename, const std::vector<std::string>& files) {
+	gl_log("Source strings for %s:\n", filename);
+	for (unsigned int i=0; i<files.size(); i++) {
+		gl_log("  %i: %s\n", i, files[i].c_str());
+	}
+}
+
+/*
+ * Builds are split in two so they can run in the background:
+ * begin_build issues everything without asking GL for any status,
+ * finish_build queries the results (which waits for the driver if
+ * it isn't done yet).
+ */
+static void begin_build(const char* vs_fn, const char* fs_fn, const char* defines,
+						program_build* build) {
+	build->start = shader_clock::now();
+	build->vs_fn = vs_fn;
+	build->fs_fn = fs_fn;
+	build->vs = build->fs = 0;
+	build->program = 0;
+	build->cached = false;
+	build->broken = false;
+	build->frame = program_frame;
+	build->issue_ms = 0.0;
+	build->ready_ms = -1.0;
+	build->deps.clear();
+
+	std::string vs_src, fs_src;
+	build->vs_files.clear();
+	build->fs_files.clear();
+	int failed = preprocessShader(vs_fn, defines, &vs_src, &build->vs_files);
+	failed += preprocessShader(fs_fn, defines, &fs_src, &build->fs_files);
+	build->deps.insert(build->deps.end(), build->vs_files.begin(), build->vs_files.end());
+	build->deps.insert(build->deps.end(), build->fs_files.begin(), build->fs_files.end());
+	if (failed) {
+		// The source is missing pieces; the compiler's errors would only
+		// point at the wrong lines.
+		gl_log_error("ERROR: #include failed, not compiling %s + %s\n", vs_fn, fs_fn);
+		build->broken = true;
+		return;
+	}
+
+	build->use_cache = cache_supported();
+	if (build->use_cache) {
+		build->key = driver_hash();
+		build->key = hash_string(vs_src.c_str(), build->key);
+		build->key = hash_string(fs_src.c_str(), build->key);
+
+		double compile_ms = 0.0;
+		build->program = load_cached_program(build->key, &compile_ms);
+		if (build->program) {
+			double load_ms = ms_since(build->start);
+			program_cache.hits++;
+			program_cache.load_ms += load_ms;
+			program_cache.ms_saved += compile_ms - load_ms;
+			gl_log("Program cache hit for %s + %s: %.2fms (compile was %.2fms)\n",
+				   vs_fn, fs_fn, load_ms, compile_ms);
+			build->cached = true;
+			return;
+		}
+		program_cache.misses++;
+	}
+
+	const char* vs_str = vs_src.c_str();
+	const char* fs_str = fs_src.c_str();
+	build->vs = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(build->vs, 1, &vs_str, NULL);
+	glCompileShader(build->vs);
+	build->fs = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(build->fs, 1, &fs_str, NULL);
+	glCompileShader(build->fs);
+	build->program = glCreateProgram();
+	glAttachShader(build->program, build->fs);
+	glAttachShader(build->program, build->vs);
+	if (build->use_cache) {
+		glProgramParameteri(build->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+	glLinkProgram(build->program);
+	build->issue_ms = ms_since(build->start);
+}
+
+// True once finish_build won't block, or without the extension, once
+// the driver has had the rest of the frame the build was issued in.
+static bool build_ready(const program_build* build) {
+	if (build->cached || build->broken) { return true; }
+	if (!gl_caps.parallel_shader_compile) { return build->frame != program_frame; }
+	GLint done = GL_FALSE;
+	glGetProgramiv(build->program, GL_COMPLETION_STATUS_KHR, &done);
+	return done == GL_TRUE;
+}
+
+// Returns true if the program linked; it's left in build->program either way.
+static bool finish_build(program_build* build) {
+	if (build->cached) { return true; }
+	if (build->broken) { return false; }
+
+	shader_clock::time_point finish_start = shader_clock::now();
+	if (!shader_compiled(build->vs, build->vs_fn.c_str())) {
+		log_source_strings(build->vs_fn.c_str(), build->vs_files);
+	}
+	if (!shader_compiled(build->fs, build->fs_fn.c_str())) {
+		log_source_strings(build->fs_fn.c_str(), build->fs_files);
+	}
+	bool linked = programLinked(build->program, build->fs_fn.c_str());
+	// The program keeps what it needs.
+	glDetachShader(build->program, build->fs);
+	glDetachShader(build->program, build->vs);
+	glDeleteShader(build->fs);
+	glDeleteShader(build->vs);
+	build->vs = build->fs = 0;
+
+	if (linked && build->use_cache) {
+		// What a hit saves: the compile and link, not every frame since
+		// begin_build. The driver does the work in the calls that issue
+		// and check the build, or on its own threads, done by the time
+		// update_programs() saw it (a frame late at worst).
+		double compile_ms = build->issue_ms + ms_since(finish_start);
+		if (gl_caps.parallel_shader_compile && build->ready_ms >= 0.0) {
+			compile_ms = build->ready_ms;
+		}
+		save_cached_program(build->program, build->key, compile_ms);
+		gl_log("Compiled %s + %s in %.2fms\n",
+			   build->vs_fn.c_str(), build->fs_fn.c_str(), compile_ms);
+	}
+	return linked;
+}
+
+/*
+ * Build a program from a vertex and fragment shader, through the cache.
+ */
+GLuint createProgram(const char* vs_fn, const char* fs_fn, const char* defines) {
+	std::vector<std::string> deps;
+	return createProgram(vs_fn, fs_fn, defines, &deps);
+}
+
+GLuint createProgram(const char* vs_fn, const char* fs_fn, const char* defines,
+					 std::vector<std::string>* deps) {
+	program_build build;
+	begin_build(vs_fn, fs_fn, defines, &build);
+	finish_build(&build);
+	deps->insert(deps->end(), build.deps.begin(), build.deps.end());
+	return build.program;
+}
+
+void log_program_cache_stats() {
+	gl_log("Program cache: %i hits, %i misses; loaded in %.2fms, saved ~%.2fms of startup\n",
+		   program_cache.hits, program_cache.misses,
+		   program_cache.load_ms, program_cache.ms_saved);
+}
+
+/*
+ * Permutation cache.
+ * getProgram only starts a build; update_programs() finishes it once the
+ * driver is done, and until then programObject() hands out the fallback.
+ */
+static GLuint fallback_program = 0;
+
+int initFallbackProgram(const char* vs_fn, const char* fs_fn) {
+	// Small enough to build synchronously.
+	fallback_program = createProgram(vs_fn, fs_fn, "");
+	if (!fallback_program) { return 1; }
+	GLint linked = GL_FALSE;
+	glGetProgramiv(fallback_program, GL_LINK_STATUS, &linked);
+	return (linked == GL_TRUE) ? 0 : 1;
+}
+
+int getProgram(const char* vs_fn, const char* fs_fn, const shader_defines* defines) {
+	std::string block = define_block(defines);
+	std::string key = std::string(vs_fn) + "\n" + fs_fn + "\n" + block;
+	std::map<std::string, int>::iterator it = program_handles.find(key);
+	if (it != program_handles.end()) { return it->second; }
+
+	shader_program p;
+	p.vs_fn = vs_fn;
+	p.fs_fn = fs_fn;
+	p.defines = block;
+	p.program = 0;
+	p.building = true;
+	begin_build(vs_fn, fs_fn, block.c_str(), &p.build);
+	p.deps = p.build.deps;
+	// Cache hits are ready right away.
+	if (p.build.cached) {
+		finish_build(&p.build);
+		p.program = p.build.program;
+		p.building = false;
+	}
+	programs.push_back(p);
+	int handle = programs.size() - 1;
+	program_handles[key] = handle;
+	return handle;
+}
+
+GLuint programObject(int handle) {
+	GLuint program = programs[handle].program;
+	return program ? program : fallback_program;
+}
+
+bool programReady(int handle) {
+	return programs[handle].program != 0;
+}
+
+int programs_building() {
+	int building = 0;
+	for (unsigned int i=0; i<programs.size(); i++) {
+		if (programs[i].building) { building++; }
+	}
+	return building;
+}
+
+static void cancel_build(shader_program* p) {
+	if (!p->building) { return; }
+	program_build* b = &p->build;
+	if (b->vs) { glDeleteShader(b->vs); }
+	if (b->fs) { glDeleteShader(b->fs); }
+	glDeleteProgram(b->program);
+	p->building = false;
+}
+
+int update_programs() {
+	int swapped = 0;
+	for (unsigned int i=0; i<programs.size(); i++) {
+		shader_program* p = &programs[i];
+		if (!p->building || !build_ready(&p->build)) { continue; }
+		p->build.ready_ms = ms_since(p->build.start);
+		p->building = false;
+		bool first = (p->program == 0);
+		if (!finish_build(&p->build)) {
+			gl_log_error("ERROR: build of %s + %s failed, %s\n", p->vs_fn.c_str(), p->fs_fn.c_str(),
+						 first ? "drawing with the fallback" : "keeping the old program");
+			glDeleteProgram(p->build.program);
+			// Watch what the broken source includes, so fixing a new
+			// include file rebuilds it too.
+			p->deps = p->build.deps;
+			continue;
+		}
+		// Nothing else to carry over: bindings and locations are explicit
+		// in the shaders and per-draw uniforms are set every frame.
+		if (p->program) {
+			gl_forget_program(p->program);
+			glDeleteProgram(p->program);
+		}
+		p->program = p->build.program;
+		p->deps = p->build.deps;
+		gl_log("%s %s + %s after %.2fms\n", first ? "Built" : "Reloaded",
+			   p->vs_fn.c_str(), p->fs_fn.c_str(), ms_since(p->build.start));
+		swapped++;
+		// Without KHR_parallel_shader_compile finishing blocks,
+		// so only take that hit once per frame.
+		if (!gl_caps.parallel_shader_compile) { break; }
+	}
+	program_frame++;
+	return swapped;
+}
+
+/*
+ * Hot reload.
+ * A rebuild runs next to the live program; the handle only switches over
+ * once the new one links, so a typo just logs and leaves the old one up.
+ */
+static bool depends_on(const shader_program* p, const std::string& filename) {
+	for (unsigned int i=0; i<p->deps.size(); i++) {
+		if (p->deps[i] == filename) { return true; }
+	}
+	return false;
+}
+
+int reloadPrograms(const char* changed_file) {
+	std::string filename = changed_file;
+	int started = 0;
+	for (unsigned int i=0; i<programs.size(); i++) {
+		shader_program* p = &programs[i];
+		if (!depends_on(p, filename)) { continue; }
+		// Saved again before the last build finished; that one's stale.
+		cancel_build(p);
+		begin_build(p->vs_fn.c_str(), p->fs_fn.c_str(), p->defines.c_str(), &p->build);
+		p->building = true;
+		started++;
+	}
+	if (started) {
+		gl_log("%s changed, rebuilding %i program(s)\n", changed_file, started);
+	}
+	return started;
+}
@@ -0,0 +1,133 @@
+#ifndef KESHI_SHADER
+#define KESHI_SHADER
+
+#include <GL/glew.h>
+
+#include <stdint.h>
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#define PROGRAM_CACHE_DIR "cache/"
+#define PROGRAM_CACHE_MAGIC "KPRG"
+#define PROGRAM_CACHE_VERSION 1
+// Where #include "..." looks when the file isn't next to the includer.
+#define SHADER_INCLUDE_DIR "shaders/include/"
+#define SHADER_MAX_INCLUDE_DEPTH 16
+
+/*
+ * A set of #defines selecting one permutation of a shader pair.
+ * Kept sorted so equal sets always produce the same text and cache key.
+ */
+struct shader_defines {
+	std::map<std::string, std::string> values;
+};
+
+void define(shader_defines* defines, const char* name);
+void define(shader_defines* defines, const char* name, int value);
+std::string define_block(const shader_defines* defines);
+
+/*
+ * A program on its way from source to linked, see begin_build() in shader.cpp.
+ */
+struct program_build {
+	std::string vs_fn;
+	std::string fs_fn;
+	GLuint vs, fs;
+	GLuint program;
+	bool cached;
+	// Preprocessing failed, so nothing was compiled; 'program' is 0.
+	bool broken;
+	bool use_cache;
+	uint64_t key;
+	std::chrono::steady_clock::time_point start;
+	// update_programs() calls before it was issued.
+	unsigned long frame;
+	// Spent issuing it, and when update_programs() found it done
+	// (-1 until then); see finish_build().
+	double issue_ms;
+	double ready_ms;
+	std::vector<std::string> vs_files;
+	std::vector<std::string> fs_files;
+	std::vector<std::string> deps;
+};
+
+/*
+ * One compiled permutation. 'deps' lists every file that went into it,
+ * includes too. 'program' is 0 until the first build finishes;
+ * 'build' is the one in flight, first or hot reload.
+ */
+struct shader_program {
+	std::string vs_fn;
+	std::string fs_fn;
+	std::string defines;
+	GLuint program;
+	std::vector<std::string> deps;
+	bool building;
+	program_build build;
+};
+
+/*
+ * On-disk program binary cache.
+ * Linked programs are saved with glGetProgramBinary under a 64-bit hash
+ * of their sources (defines included) and the driver's vendor, renderer
+ * and version strings, so a driver update is just a miss.
+ * A binary the driver refuses is treated the same way.
+ */
+struct program_cache_header {
+	char magic[4];
+	uint32_t version;
+	uint64_t key;
+	uint32_t binary_format;
+	uint32_t binary_length;
+	// How long the full compile + link took, to report what a hit saves.
+	double compile_ms;
+};
+
+struct program_cache_stats {
+	int hits;
+	int misses;
+	double load_ms;
+	double ms_saved;
+};
+
+extern program_cache_stats program_cache;
+
+uint64_t hash_bytes(const void* data, unsigned long len, uint64_t hash);
+uint64_t hash_string(const char* str, uint64_t hash);
+
+// Shader preprocessing: #include resolution plus the define block.
+int preprocessShader(const char* filename, const char* defines,
+					 std::string* source, std::vector<std::string>* deps);
+
+GLuint createProgram(const char* vs_fn, const char* fs_fn, const char* defines);
+GLuint createProgram(const char* vs_fn, const char* fs_fn, const char* defines,
+					 std::vector<std::string>* deps);
+bool programLinked(GLuint program, const char* name);
+void log_program_cache_stats();
+
+/*
+ * Permutation cache: each distinct (vs, fs, defines) is built once.
+ * Builds run in the background: getProgram() issues the compile and link
+ * and returns a handle straight away, and update_programs() picks the
+ * program up once GL_COMPLETION_STATUS_KHR says it's done (without
+ * KHR_parallel_shader_compile, on the next call after it was issued, and
+ * that one may block). Until then programObject() returns the fallback.
+ * Issue every getProgram() up front to overlap them all.
+ */
+// The stand-in; built synchronously, so keep it cheap.
+int initFallbackProgram(const char* vs_fn, const char* fs_fn);
+int getProgram(const char* vs_fn, const char* fs_fn, const shader_defines* defines);
+GLuint programObject(int handle);
+bool programReady(int handle);
+int programs_building();
+// Once per frame: swaps in builds that have finished linking.
+int update_programs();
+
+// Hot reload (see shaderwatch.h).
+// Starts rebuilding every program built from 'changed_file'.
+int reloadPrograms(const char* changed_file);
+
+#endif
@@ -0,0 +1,19 @@
+#version 430
+
+// Stand-in while the real programs compile (see getProgram in shader.cpp).
+// Flat shaded, tinted per material and brighter the more lights reach
+// the draw, so things stay distinguishable. It declares the same
+// explicit-location uniforms as test.frag so main.cpp can set them
+// whichever program is bound.
+layout(location = 0) uniform int material_index;
+layout(location = 1) uniform ivec2 light_list;
+
+in vec3 pos_E, norm_E;
+out vec4 frag_color;
+
+void main() {
+	vec3 tint = fract(vec3(float(material_index)) * vec3(0.31, 0.57, 0.83));
+	float lit = min(float(light_list.y), 4.0) / 4.0;
+	float facing = abs(normalize(norm_E).z);
+	frag_color = vec4(mix(vec3(0.3), tint, 0.2) * (0.6 + 0.4 * lit) * (0.5 + 0.5 * facing), 1.0);
+}
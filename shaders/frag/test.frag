@@ -1,5 +1,15 @@
-#version 420
+#version 430
+#ifdef MATERIALS_BINDLESS
+#extension GL_ARB_bindless_texture : require
+#endif
 
+// Permutations (see getProgram in shader.cpp):
+//   TEXTURED            sample a texture; otherwise use the diffuse colour.
+//   MATERIALS_BINDLESS  textures come from the material table as handles,
+//   MATERIALS_ARRAY     or as layers of one array texture. Either way,
+//                       materials that stream are bound on their own.
+//   LIGHTS_WORLD_SPACE  transform light positions per fragment, the old
+//                       way; only for './main -bench lights'.
 // Surface properties.
 vec3 Ks = vec3(1.0, 1.0, 1.0);
 vec3 Kd = vec3(1.0, 1.0, 1.0);
@@ -7,30 +17,32 @@ vec3 Ka = vec3(1.0, 1.0, 1.0);
 // specular power.
 float specular_exponent = 100.0;
 
-//uniform mat4 view, proj;
-layout (std140) uniform cam_ubo {
-	mat4 V;
-	mat4 P;
+#include "camera.glsl"
+#include "lights.glsl"
+
+#ifdef TEXTURED
+#if defined(MATERIALS_BINDLESS) || defined(MATERIALS_ARRAY)
+// Material table; see materials.h. Pick an entry with material_index.
+struct material {
+	uvec2 handle;
+	float layer;
+	float pad;
+	vec4 uv_xform;
 };
-// World space coordinates; note that incoming values are in eye/camera space.
-//uniform vec3 light_pos_W, light2_pos_W;
-// Specula, diffuse, ambient light values.
-//uniform vec3 Ls, Ld, La;
-//uniform vec3 Ls2, Ld2, La2;
-// std140 uses 4-float memory blocks, so use vec4s wherever possible.
-layout (std140) uniform lights_ubo {
-	vec4 light_pos_W;
-	vec4 light2_pos_W;
-	vec4 Ls;
-	vec4 Ld;
-	vec4 La;
-	vec4 Ls2;
-	vec4 Ld2;
-	vec4 La2;
+layout (std430, binding = 2) readonly buffer materials_ssbo {
+	material materials[];
 };
-
+layout(location = 0) uniform int material_index;
+#ifdef MATERIALS_ARRAY
+layout(binding = 0) uniform sampler2DArray material_array;
+#endif
+// Materials with a negative layer stream their mips; see materials.h.
+layout(binding = 1) uniform sampler2D material_stream;
+#else
 // Texture sampler. Use texture unit 0 - no need to glUniform this one.
 layout(binding = 0) uniform sampler2D texture_sampler;
+#endif
+#endif
 
 in vec3 pos_E, norm_E;
 in vec2 tex_coords;
@@ -38,50 +50,72 @@ out vec4 frag_color;
 
 void main() {
 	// Lighting calculations.
-	// Bring light position to eye space.
-    vec3 light_pos_E = vec3(V * light_pos_W);
-	vec3 dist_to_light_E = light_pos_E - pos_E;
-	vec3 dir_to_light_E = normalize(dist_to_light_E);
-    vec3 light2_pos_E = vec3(V * light2_pos_W);
-	vec3 dist_to_light2_E = light2_pos_E - pos_E;
-	vec3 dir_to_light2_E = normalize(dist_to_light2_E);
-
-	// Ambient intensity.
-	vec3 Ia = La.xyz * Ka;
-	vec3 Ia2 = La2.xyz * Ka;
+	vec3 to_surface = normalize(-pos_E);
+	vec3 Ia = vec3(0.0);
+	vec3 Id = vec3(0.0);
+	vec3 Is = vec3(0.0);
+	for (int i = 0; i < light_list.y; i++) {
+		light l = lights[light_indices[light_list.x + i]];
+#ifdef LIGHTS_WORLD_SPACE
+		vec3 light_pos_E = vec3(V * vec4(l.pos_E.xyz, 1.0));
+#else
+		vec3 light_pos_E = l.pos_E.xyz;
+#endif
+		vec3 dist_to_light_E = light_pos_E - pos_E;
+		float dist = length(dist_to_light_E);
+		// Out of range; this light adds nothing here.
+		float radius = l.pos_E.w;
+		if (dist >= radius) { continue; }
+		// Smooth falloff to zero at the radius.
+		float falloff = 1.0 - (dist * dist) / (radius * radius);
+		falloff *= falloff;
+		vec3 dir_to_light_E = dist_to_light_E / dist;
 
-	// Diffuse.
-	float diffuse_dot = dot(dir_to_light_E, norm_E);
-	diffuse_dot = max(diffuse_dot, 0.0);
-	vec3 Id = Ld.xyz * Kd * diffuse_dot;
-	float diffuse_dot2 = dot(dir_to_light2_E, norm_E);
-	diffuse_dot2 = max(diffuse_dot2, 0.0);
-	vec3 Id2 = Ld2.xyz * Kd * diffuse_dot2;
+		// Ambient intensity.
+		Ia += l.La.xyz * Ka * falloff;
 
-	// Specular.
-	vec3 to_surface = normalize(-pos_E);
+		// Diffuse.
+		float diffuse_dot = dot(dir_to_light_E, norm_E);
+		diffuse_dot = max(diffuse_dot, 0.0);
+		Id += l.Ld.xyz * Kd * diffuse_dot * falloff;
 
-	// Phong specular calculations.
-	/*
-	vec3 reflection = reflect(-dir_to_light_E, norm_E);
-	float specular_dot = dot(reflection, to_surface);
-	specular_dot = max(specular_dot, 0.0);
-	*/
+		// Phong specular calculations.
+		/*
+		vec3 reflection = reflect(-dir_to_light_E, norm_E);
+		float specular_dot = dot(reflection, to_surface);
+		specular_dot = max(specular_dot, 0.0);
+		*/
 
-	// Blinn-Phong specular calculations.
-	vec3 half_way = normalize(to_surface + dir_to_light_E);
-	float specular_dot = dot(half_way, norm_E);
-	specular_dot = max(specular_dot, 0.0);
-	float specular_factor = pow(specular_dot, specular_exponent);
-	vec3 Is = Ls.xyz * Ks * specular_factor;
-	vec3 half_way2 = normalize(to_surface + dir_to_light2_E);
-	float specular_dot2 = dot(half_way2, norm_E);
-	specular_dot2 = max(specular_dot2, 0.0);
-	float specular_factor2 = pow(specular_dot2, specular_exponent);
-	vec3 Is2 = Ls2.xyz * Ks * specular_factor2;
+		// Blinn-Phong specular calculations.
+		vec3 half_way = normalize(to_surface + dir_to_light_E);
+		float specular_dot = dot(half_way, norm_E);
+		specular_dot = max(specular_dot, 0.0);
+		float specular_factor = pow(specular_dot, specular_exponent);
+		Is += l.Ls.xyz * Ks * specular_factor * falloff;
+	}
 
 	// Texture sampling.
+#if !defined(TEXTURED)
+	vec4 texel = vec4(Kd, 1.0);
+#elif defined(MATERIALS_BINDLESS) || defined(MATERIALS_ARRAY)
+	// material_index is a uniform, so this branch is too.
+	material m = materials[material_index];
+	vec4 texel;
+	if (m.layer < 0.0) {
+		texel = texture(material_stream, tex_coords);
+	}
+	else {
+#ifdef MATERIALS_BINDLESS
+		texel = texture(sampler2D(m.handle), tex_coords);
+#else
+		// Clamp first, so edge clamping stays inside this material's rectangle.
+		vec2 array_coords = clamp(tex_coords, 0.0, 1.0) * m.uv_xform.zw + m.uv_xform.xy;
+		texel = texture(material_array, vec3(array_coords, m.layer));
+#endif
+	}
+#else
 	vec4 texel = texture(texture_sampler, tex_coords);
+#endif
 
-	frag_color = normalize(texel + vec4((Ia+Ia2) + (Id+Id2) + (Is+Is2), 1.0));
+	frag_color = normalize(texel + vec4(Ia + Id + Is, 1.0));
 }
@@ -0,0 +1,5 @@
+// View and projection matrices; bound to ubo_cam (0) in main.cpp.
+layout (std140, binding = 0) uniform cam_ubo {
+	mat4 V;
+	mat4 P;
+};
@@ -0,0 +1,20 @@
+// Every light in the scene, from the light_system in lights.cpp.
+// std430; each light is 4 vec4s (64 bytes).
+struct light {
+	// Eye space position, radius of influence in w.
+	// (World space in the LIGHTS_WORLD_SPACE permutation.)
+	vec4 pos_E;
+	// Specular, diffuse, ambient.
+	vec4 Ls;
+	vec4 Ld;
+	vec4 La;
+};
+layout (std430, binding = 3) readonly buffer lights_ssbo {
+	light lights[];
+};
+// Per-draw lists of the lights that reach each object, culled on the CPU.
+layout (std430, binding = 4) readonly buffer light_index_ssbo {
+	uint light_indices[];
+};
+// This draw's list: light_indices[offset, offset + count).
+layout(location = 1) uniform ivec2 light_list;
@@ -1,21 +1,20 @@
-#version 420
+#version 430
 
 layout(location = 0) in vec3 vp;
 layout(location = 1) in vec3 vn;
 layout(location = 2) in vec2 vt;
+// Per instance (locations 4-7); the identity when not instanced.
+layout(location = 4) in mat4 M;
 
-//uniform mat4 view, proj;
-layout (std140) uniform cam_ubo {
-	mat4 V;
-	mat4 P;
-};
+#include "camera.glsl"
 
 out vec3 pos_E, norm_E;
 out vec2 tex_coords;
 
 void main() {
-	pos_E = vec3(V * vec4(vp, 1.0));
-	norm_E = vec3(V * vec4(vn, 0.0));
+	// Instances are only ever uniformly scaled, so M works for normals too.
+	pos_E = vec3(V * M * vec4(vp, 1.0));
+	norm_E = vec3(V * M * vec4(vn, 0.0));
 	tex_coords = vt;
 	gl_Position = P * vec4(pos_E, 1.0);
 }
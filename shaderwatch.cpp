@@ -0,0 +1,84 @@
+#include "shaderwatch.h"
+
+#include <dirent.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <set>
+
+#include "shader.h"
+#include "util.h"
+
+// Editors often save by writing a new file and renaming it over the old one.
+#define SHADER_WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE)
+
+// inotify doesn't recurse, so add every directory under 'dir' too.
+static int watch_tree(shader_watch* watch, const std::string& dir) {
+	int wd = inotify_add_watch(watch->fd, dir.c_str(), SHADER_WATCH_EVENTS);
+	if (wd < 0) {
+		gl_log_error("ERROR: Could not watch %s\n", dir.c_str());
+		return 1;
+	}
+	if ((int)watch->dirs.size() <= wd) { watch->dirs.resize(wd + 1); }
+	watch->dirs[wd] = dir;
+
+	DIR* d = opendir(dir.c_str());
+	if (!d) { return 0; }
+	int failed = 0;
+	struct dirent* entry;
+	while ((entry = readdir(d)) != NULL) {
+		if (entry->d_name[0] == '.' || entry->d_type != DT_DIR) { continue; }
+		failed += watch_tree(watch, dir + entry->d_name + "/");
+	}
+	closedir(d);
+	return failed;
+}
+
+int init_shader_watch(shader_watch* watch, const char* dir) {
+	watch->dirs.clear();
+	watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (watch->fd < 0) {
+		gl_log_error("ERROR: inotify unavailable, shader hot reload is off\n");
+		return 1;
+	}
+	std::string root = dir;
+	if (root.empty() || root[root.size()-1] != '/') { root += "/"; }
+	int failed = watch_tree(watch, root);
+	gl_log("Watching %s for shader changes\n", root.c_str());
+	return failed ? 1 : 0;
+}
+
+void update_shader_watch(shader_watch* watch) {
+	if (watch->fd < 0) { return; }
+	// One save can raise several events; rebuild once per file.
+	std::set<std::string> changed;
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	for (;;) {
+		ssize_t len = read(watch->fd, buf, sizeof(buf));
+		if (len <= 0) { break; }
+		for (char* p = buf; p < buf + len; ) {
+			const struct inotify_event* event = (const struct inotify_event*)p;
+			p += sizeof(struct inotify_event) + event->len;
+			if (event->len == 0 || event->wd >= (int)watch->dirs.size()) { continue; }
+			std::string path = watch->dirs[event->wd] + event->name;
+			if (event->mask & IN_ISDIR) {
+				// New directory; watch it too.
+				if (event->mask & (IN_CREATE | IN_MOVED_TO)) { watch_tree(watch, path + "/"); }
+				continue;
+			}
+			// Skip the create half of a plain write; the close follows.
+			if (event->mask & IN_CREATE) { continue; }
+			changed.insert(path);
+		}
+	}
+	std::set<std::string>::iterator it;
+	for (it = changed.begin(); it != changed.end(); ++it) {
+		reloadPrograms(it->c_str());
+	}
+}
+
+void shutdown_shader_watch(shader_watch* watch) {
+	if (watch->fd >= 0) { close(watch->fd); }
+	watch->fd = -1;
+	watch->dirs.clear();
+}
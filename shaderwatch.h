@@ -0,0 +1,26 @@
+#ifndef KESHI_SHADERWATCH
+#define KESHI_SHADERWATCH
+
+#include <string>
+#include <vector>
+
+#define SHADER_WATCH_DIR "shaders/"
+
+/*
+ * Shader hot reload.
+ * Watches a directory tree with inotify and hands every changed file
+ * to reloadPrograms(); rebuilt programs are swapped in by
+ * update_programs() once they link, never mid-frame.
+ */
+struct shader_watch {
+	int fd;
+	// Indexed by inotify watch descriptor, each with a trailing '/'.
+	std::vector<std::string> dirs;
+};
+
+int init_shader_watch(shader_watch* watch, const char* dir);
+// Once per frame; never blocks.
+void update_shader_watch(shader_watch* watch);
+void shutdown_shader_watch(shader_watch* watch);
+
+#endif
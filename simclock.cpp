@@ -0,0 +1,43 @@
+#include "simclock.h"
+
+#include "util.h"
+
+void init_sim_clock(sim_clock* clock, double hz, double now_sec) {
+	if (!(hz > 0.0)) {
+		gl_log_error("ERROR: Simulation rate of %.2f Hz, using %.0f\n", hz, SIM_DEFAULT_HZ);
+		hz = SIM_DEFAULT_HZ;
+	}
+	clock->step_sec = 1.0 / hz;
+	clock->accumulator = 0.0;
+	clock->prev_sec = now_sec;
+	clock->steps = 0;
+	clock->frames = 0;
+	clock->dropped_sec = 0.0;
+	gl_log("Simulation: %.2f steps per second\n", hz);
+}
+
+int advance_sim_clock(sim_clock* clock, double now_sec) {
+	double elapsed = now_sec - clock->prev_sec;
+	clock->prev_sec = now_sec;
+	if (elapsed > 0.0) { clock->accumulator += elapsed; }
+	int steps = (int)(clock->accumulator / clock->step_sec);
+	if (steps > SIM_MAX_STEPS) {
+		clock->dropped_sec += (steps - SIM_MAX_STEPS) * clock->step_sec;
+		steps = SIM_MAX_STEPS;
+	}
+	clock->accumulator -= (int)(clock->accumulator / clock->step_sec) * clock->step_sec;
+	clock->steps += steps;
+	clock->frames++;
+	return steps;
+}
+
+float sim_alpha(const sim_clock* clock) {
+	float alpha = (float)(clock->accumulator / clock->step_sec);
+	return (alpha < 1.0f) ? alpha : 1.0f;
+}
+
+void log_sim_clock(const sim_clock* clock) {
+	gl_log("Simulation: %lu steps over %lu frames (%.2f per frame), %.3fs dropped\n",
+		   clock->steps, clock->frames, clock->frames ? (double)clock->steps / clock->frames : 0.0,
+		   clock->dropped_sec);
+}
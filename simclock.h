@@ -0,0 +1,32 @@
+#ifndef KESHI_SIMCLOCK
+#define KESHI_SIMCLOCK
+
+#define SIM_DEFAULT_HZ 120.0
+// Most steps run in one frame; time past that is dropped.
+#define SIM_MAX_STEPS 8
+
+/*
+ * Fixed-step simulation time. Real time goes into an accumulator and
+ * comes out in whole steps, so the simulation costs the same and comes
+ * out the same at any frame rate. What's left over says how far between
+ * the last two steps this frame is, for interpolating what gets drawn.
+ * After a long stall (a breakpoint, a window drag) only SIM_MAX_STEPS
+ * run, so a slow frame can't snowball into slower ones.
+ */
+struct sim_clock {
+	double step_sec;
+	double accumulator;
+	double prev_sec;
+	unsigned long steps;
+	unsigned long frames;
+	double dropped_sec;
+};
+
+void init_sim_clock(sim_clock* clock, double hz, double now_sec);
+// Adds the time since the last call; returns how many steps to run.
+int advance_sim_clock(sim_clock* clock, double now_sec);
+// 0 to 1, from the start of the last step to its end.
+float sim_alpha(const sim_clock* clock);
+void log_sim_clock(const sim_clock* clock);
+
+#endif
@@ -0,0 +1,3 @@
+// stb_image implementation lives in its own unit so tools can link it without GL.
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
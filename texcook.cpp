@@ -0,0 +1,62 @@
+/*
+ * Offline texture cooker.
+ * Usage: texcook [-qoi] <image> [<image> ...]
+ * Writes textures/ktex/<name>.ktex for each input image, and with -qoi
+ * also a losslessly re-encoded textures/qoi/<name>.qoi.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "math2d.h"
+#include "qoi.h"
+#include "texture.h"
+#include "util.h"
+
+int main(int argc, char** args) {
+	bool write_qoi = false;
+	int first = 1;
+	if (argc > 1 && strcmp(args[1], "-qoi") == 0) {
+		write_qoi = true;
+		first++;
+	}
+	if (argc <= first) {
+		fprintf(stderr, "Usage: %s [-qoi] <image> [<image> ...]\n", args[0]);
+		return 1;
+	}
+
+	int failed = 0;
+	for (int i=first; i<argc; i++) {
+		int x, y;
+		unsigned char* data = load_image(args[i], &x, &y, 4);
+		if (!data) {
+			fprintf(stderr, "Error: Could not load image: %s\n", args[i]);
+			failed++;
+			continue;
+		}
+
+		char out_fn[256];
+		if (write_qoi) {
+			// Same row order as the source image.
+			qoi_texture_path(args[i], out_fn, sizeof(out_fn));
+			if (qoi_write(out_fn, data, x, y, 4) != 0) {
+				fprintf(stderr, "Error: Could not write %s\n", out_fn);
+				failed++;
+			}
+			else {
+				printf("%s -> %s\n", args[i], out_fn);
+			}
+		}
+
+		flip_tex_V(data, x, y, 4);
+		cooked_texture_path(args[i], out_fn, sizeof(out_fn));
+		if (cook_texture(data, x, y, out_fn) != 0) {
+			failed++;
+		}
+		else {
+			printf("%s -> %s\n", args[i], out_fn);
+		}
+		free_image(data);
+	}
+
+	return failed ? 1 : 0;
+}
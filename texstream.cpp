@@ -0,0 +1,217 @@
+#include "texstream.h"
+
+#include <math.h>
+
+#include "glstate.h"
+#include "math3d.h"
+#include "util.h"
+
+void init_texture_streamer(texture_streamer* s, unsigned long budget_bytes) {
+	s->textures.clear();
+	s->budget_bytes = budget_bytes;
+	s->uploads_per_frame = STREAM_DEFAULT_UPLOADS_PER_FRAME;
+	s->stats = stream_stats();
+	s->stats.budget_bytes = budget_bytes;
+}
+
+void shutdown_texture_streamer(texture_streamer* s) {
+	for (unsigned int i=0; i<s->textures.size(); i++) {
+		unmap_ktex(&s->textures[i].file);
+		gl_forget_texture(s->textures[i].tex);
+		glDeleteTextures(1, &s->textures[i].tex);
+	}
+	s->textures.clear();
+}
+
+/*
+ * Specify one level from the mapped file. Levels are mutable storage
+ * so a single one can be released again (see evict_level).
+ */
+static void specify_level(streamed_texture* t, int level) {
+	const ktex_header* h = t->file.header;
+	const ktex_level* lvl = &h->levels[level];
+	if (h->flags & KTEX_FLAG_COMPRESSED) {
+		glCompressedTexImage2D(GL_TEXTURE_2D, level, h->gl_internal_format,
+							   lvl->width, lvl->height, 0, lvl->size,
+							   t->file.data + lvl->offset);
+	}
+	else {
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexImage2D(GL_TEXTURE_2D, level, h->gl_internal_format,
+					 lvl->width, lvl->height, 0, h->gl_format, h->gl_type,
+					 t->file.data + lvl->offset);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	}
+	t->resident_bytes += lvl->size;
+}
+
+static unsigned long level_bytes(const streamed_texture* t, int level) {
+	return t->file.header->levels[level].size;
+}
+
+int stream_texture(texture_streamer* s, const char* filename, GLuint* tex) {
+	char cooked_fn[256];
+	cooked_texture_path(filename, cooked_fn, sizeof(cooked_fn));
+
+	streamed_texture t;
+	if (!twin_is_current(filename, cooked_fn) || map_ktex(cooked_fn, &t.file) != 0) { return -1; }
+	const ktex_header* h = t.file.header;
+	t.num_levels = h->num_levels;
+	t.min_base = t.num_levels - 1;
+	for (int i=0; i<t.num_levels; i++) {
+		if (h->levels[i].width <= STREAM_MIN_RESIDENT_SIZE &&
+			h->levels[i].height <= STREAM_MIN_RESIDENT_SIZE) {
+			t.min_base = i;
+			break;
+		}
+	}
+	t.resident_base = t.wanted_base = t.logged_base = t.min_base;
+	t.resident_bytes = 0;
+
+	gl_active_texture(GL_TEXTURE0 + STREAM_UPLOAD_UNIT);
+	glGenTextures(1, &t.tex);
+	gl_bind_texture(GL_TEXTURE_2D, t.tex);
+	for (int i=t.min_base; i<t.num_levels; i++) {
+		specify_level(&t, i);
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, t.min_base);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, t.num_levels - 1);
+	gl_active_texture(GL_TEXTURE0);
+
+	s->stats.resident_bytes += t.resident_bytes;
+	*tex = t.tex;
+	s->textures.push_back(t);
+	return s->textures.size() - 1;
+}
+
+/*
+ * Approximate on-screen diameter in pixels of a bounding sphere,
+ * for the vertical fov (degrees) that perspective() is given.
+ */
+float screen_footprint(float radius, float distance, float fov, int viewport_h) {
+	// Inside the sphere, it can cover the whole screen.
+	if (distance <= radius) { return (float)viewport_h; }
+	float half_h = distance * tan(ang_to_rad(fov) * 0.5f);
+	return viewport_h * radius / half_h;
+}
+
+void request_texture_lod(texture_streamer* s, int handle, float footprint_px) {
+	if (handle < 0 || handle >= (int)s->textures.size()) { return; }
+	streamed_texture* t = &s->textures[handle];
+	const ktex_header* h = t->file.header;
+
+	// Mip level whose texels roughly match the footprint's pixels.
+	float size = (float)((h->width > h->height) ? h->width : h->height);
+	int level = 0;
+	if (footprint_px < size) {
+		level = (footprint_px > 1.0f) ? (int)floor(log2(size / footprint_px)) : t->min_base;
+	}
+	if (level > t->min_base) { level = t->min_base; }
+	if (level < t->wanted_base) { t->wanted_base = level; }
+}
+
+static void evict_level(texture_streamer* s, streamed_texture* t) {
+	int level = t->resident_base;
+	gl_bind_texture(GL_TEXTURE_2D, t->tex);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level + 1);
+	// A zero-sized image releases the level's memory.
+	glTexImage2D(GL_TEXTURE_2D, level, t->file.header->gl_internal_format,
+				 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	t->resident_bytes -= level_bytes(t, level);
+	s->stats.resident_bytes -= level_bytes(t, level);
+	s->stats.evictions++;
+	t->resident_base++;
+}
+
+// Texture holding the most resident detail it doesn't currently want.
+static streamed_texture* eviction_candidate(texture_streamer* s) {
+	streamed_texture* best = NULL;
+	int best_excess = 0;
+	for (unsigned int i=0; i<s->textures.size(); i++) {
+		streamed_texture* t = &s->textures[i];
+		int excess = t->wanted_base - t->resident_base;
+		if (t->resident_base < t->min_base && excess > best_excess) {
+			best = t;
+			best_excess = excess;
+		}
+	}
+	return best;
+}
+
+void update_texture_streamer(texture_streamer* s) {
+	for (unsigned int i=0; i<s->textures.size(); i++) {
+		streamed_texture* t = &s->textures[i];
+		if (t->wanted_base == t->logged_base) { continue; }
+		const ktex_level* lvl = &t->file.header->levels[t->wanted_base];
+		log_info(LOG_TEXTURE, "Texture streaming: texture %u wants level %i (%ux%u), %i resident\n",
+				 i, t->wanted_base, lvl->width, lvl->height, t->resident_base);
+		t->logged_base = t->wanted_base;
+	}
+
+	gl_active_texture(GL_TEXTURE0 + STREAM_UPLOAD_UNIT);
+
+	for (int u=0; u<s->uploads_per_frame; u++) {
+		// Biggest shortfall first.
+		streamed_texture* t = NULL;
+		int best_gap = 0;
+		for (unsigned int i=0; i<s->textures.size(); i++) {
+			int gap = s->textures[i].resident_base - s->textures[i].wanted_base;
+			if (gap > best_gap) {
+				t = &s->textures[i];
+				best_gap = gap;
+			}
+		}
+		if (!t) { break; }
+
+		int level = t->resident_base - 1;
+		unsigned long need = level_bytes(t, level);
+		while (s->stats.resident_bytes + need > s->budget_bytes) {
+			streamed_texture* victim = eviction_candidate(s);
+			if (!victim) { break; }
+			evict_level(s, victim);
+		}
+		if (s->stats.resident_bytes + need > s->budget_bytes) {
+			s->stats.budget_misses++;
+			// Stop asking for it this frame.
+			t->wanted_base = t->resident_base;
+			continue;
+		}
+
+		gl_bind_texture(GL_TEXTURE_2D, t->tex);
+		specify_level(t, level);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+		t->resident_base = level;
+		s->stats.resident_bytes += need;
+		s->stats.uploaded_bytes += need;
+		s->stats.uploads++;
+	}
+
+	// The budget may have shrunk.
+	while (s->stats.resident_bytes > s->budget_bytes) {
+		streamed_texture* victim = eviction_candidate(s);
+		if (!victim) { break; }
+		evict_level(s, victim);
+	}
+
+	s->stats.budget_bytes = s->budget_bytes;
+	s->stats.wanted_bytes = 0;
+	for (unsigned int i=0; i<s->textures.size(); i++) {
+		streamed_texture* t = &s->textures[i];
+		for (int l=t->wanted_base; l<t->num_levels; l++) {
+			s->stats.wanted_bytes += level_bytes(t, l);
+		}
+		// Requests are per-frame.
+		t->wanted_base = t->min_base;
+	}
+
+	gl_active_texture(GL_TEXTURE0);
+}
+
+void log_stream_stats(const texture_streamer* s) {
+	const stream_stats* st = &s->stats;
+	gl_log("Texture streaming: %lu textures, %luKB resident / %luKB wanted / %luKB budget\n",
+		   (unsigned long)s->textures.size(), st->resident_bytes / 1024,
+		   st->wanted_bytes / 1024, st->budget_bytes / 1024);
+	gl_log("  %lu uploads (%luKB), %lu evictions, %lu budget misses\n",
+		   st->uploads, st->uploaded_bytes / 1024, st->evictions, st->budget_misses);
+}
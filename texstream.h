@@ -0,0 +1,66 @@
+#ifndef KESHI_TEXSTREAM
+#define KESHI_TEXSTREAM
+
+#include <GL/glew.h>
+
+#include <vector>
+
+#include "texture.h"
+
+// Levels at or below this size are uploaded up front and never evicted.
+#define STREAM_MIN_RESIDENT_SIZE 32
+// Texture unit used for uploads, so streaming never disturbs unit 0.
+#define STREAM_UPLOAD_UNIT 15
+#define STREAM_DEFAULT_BUDGET (64 * 1024 * 1024)
+#define STREAM_DEFAULT_UPLOADS_PER_FRAME 4
+
+/*
+ * Progressive mip streaming for cooked (.ktex) textures.
+ * Each texture keeps its file mapped and only has levels
+ * [resident_base, num_levels) specified in GL; GL_TEXTURE_BASE_LEVEL
+ * follows resident_base, so sampling never touches missing levels.
+ * Every frame the renderer reports how large each texture appears on
+ * screen, and update_texture_streamer() uploads the finer levels that
+ * are wanted and evicts the ones that aren't, within a byte budget.
+ */
+struct streamed_texture {
+	GLuint tex;
+	ktex_file file;
+	int num_levels;
+	int min_base;       // Coarsest level that's always resident.
+	int resident_base;  // Finest level currently in GL.
+	int wanted_base;    // Finest level asked for this frame.
+	int logged_base;    // Last wanted level written to the log.
+	unsigned long resident_bytes;
+};
+
+struct stream_stats {
+	unsigned long resident_bytes;
+	unsigned long wanted_bytes;
+	unsigned long budget_bytes;
+	unsigned long uploads;
+	unsigned long evictions;
+	unsigned long uploaded_bytes;
+	// Levels we wanted but couldn't fit in the budget this frame.
+	unsigned long budget_misses;
+};
+
+struct texture_streamer {
+	std::vector<streamed_texture> textures;
+	unsigned long budget_bytes;
+	int uploads_per_frame;
+	stream_stats stats;
+};
+
+void init_texture_streamer(texture_streamer* s, unsigned long budget_bytes);
+void shutdown_texture_streamer(texture_streamer* s);
+// Returns a handle for request_texture_lod, or -1 (no cooked file, or
+// one older than the source).
+int stream_texture(texture_streamer* s, const char* filename, GLuint* tex);
+
+float screen_footprint(float radius, float distance, float fov, int viewport_h);
+void request_texture_lod(texture_streamer* s, int handle, float footprint_px);
+void update_texture_streamer(texture_streamer* s);
+void log_stream_stats(const texture_streamer* s);
+
+#endif
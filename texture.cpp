@@ -0,0 +1,477 @@
+#include "texture.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <thread>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "glresource.h"
+#include "glstate.h"
+#include "math2d.h"
+#include "qoi.h"
+#include "util.h"
+#include "stb_image.h"
+
+#define KTEX_DIR "textures/ktex/"
+#define QOI_DIR "textures/qoi/"
+
+/*
+ * Cooked texture files.
+ */
+// Bytes a w x h level takes in the header's format; 0 if it's one we
+// don't know, so it can't be checked.
+static uint64_t ktex_level_bytes(const ktex_header* h, uint32_t w, uint32_t ht) {
+	if (h->flags & KTEX_FLAG_COMPRESSED) {
+		uint64_t block = 0;
+		switch (h->gl_internal_format) {
+		case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_RED_RGTC1:
+		case GL_COMPRESSED_SIGNED_RED_RGTC1:
+			block = 8;
+			break;
+		case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+		case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+		case GL_COMPRESSED_RG_RGTC2:
+		case GL_COMPRESSED_SIGNED_RG_RGTC2:
+		case GL_COMPRESSED_RGBA_BPTC_UNORM:
+		case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+			block = 16;
+			break;
+		default:
+			return 0;
+		}
+		return (uint64_t)((w + 3) / 4) * ((ht + 3) / 4) * block;
+	}
+	if (h->gl_type != GL_UNSIGNED_BYTE) { return 0; }
+	uint64_t pixel = 0;
+	switch (h->gl_format) {
+	case GL_RED: pixel = 1; break;
+	case GL_RG: pixel = 2; break;
+	case GL_RGB: pixel = 3; break;
+	case GL_RGBA: pixel = 4; break;
+	default: return 0;
+	}
+	return (uint64_t)w * ht * pixel;
+}
+
+int map_ktex(const char* filename, ktex_file* file) {
+	file->header = NULL;
+	file->data = NULL;
+	file->size = 0;
+
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) { return 1; }
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (unsigned long)st.st_size < sizeof(ktex_header)) {
+		close(fd);
+		return 1;
+	}
+
+	void* mem = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping holds its own reference to the file.
+	close(fd);
+	if (mem == MAP_FAILED) {
+		gl_log_error("ERROR: Could not map texture %s\n", filename);
+		return 1;
+	}
+
+	const ktex_header* header = (const ktex_header*)mem;
+	bool valid = (memcmp(header->magic, KTEX_MAGIC, 8) == 0 &&
+				  header->version == KTEX_VERSION &&
+				  header->num_levels > 0 &&
+				  header->num_levels <= KTEX_MAX_LEVELS);
+	// Every level has to be the size its dimensions say, each half the
+	// last, and inside the file, or GL reads off the end of the mapping.
+	uint32_t w = header->width;
+	uint32_t h = header->height;
+	for (unsigned int i=0; valid && i<header->num_levels; i++) {
+		const ktex_level* lvl = &header->levels[i];
+		uint64_t expected = ktex_level_bytes(header, w, h);
+		valid = (w > 0 && h > 0 && lvl->width == w && lvl->height == h &&
+				 expected != 0 && lvl->size == expected &&
+				 lvl->offset <= (uint64_t)st.st_size && lvl->size <= (uint64_t)st.st_size - lvl->offset);
+		w = (w > 1) ? w / 2 : 1;
+		h = (h > 1) ? h / 2 : 1;
+	}
+	if (!valid) {
+		gl_log_error("ERROR: %s is not a valid v%i texture file\n", filename, KTEX_VERSION);
+		munmap(mem, st.st_size);
+		return 1;
+	}
+
+	file->header = header;
+	file->data = (const unsigned char*)mem;
+	file->size = st.st_size;
+	return 0;
+}
+
+void unmap_ktex(ktex_file* file) {
+	if (file->data) {
+		munmap((void*)file->data, file->size);
+	}
+	file->header = NULL;
+	file->data = NULL;
+	file->size = 0;
+}
+
+/*
+ * Upload a single level into a texture that already has immutable
+ * storage for it (see upload_ktex).
+ */
+int upload_ktex_level(const ktex_file* file, GLuint tex, int level) {
+	const ktex_header* h = file->header;
+	if (level < 0 || level >= (int)h->num_levels) { return 1; }
+	const ktex_level* lvl = &h->levels[level];
+
+	if (h->flags & KTEX_FLAG_COMPRESSED) {
+		compressed_texture_sub_image_2d(tex, level, lvl->width, lvl->height, h->gl_internal_format,
+										lvl->size, file->data + lvl->offset);
+	}
+	else {
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		texture_sub_image_2d(tex, level, lvl->width, lvl->height, h->gl_format, h->gl_type,
+							 file->data + lvl->offset);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	}
+	return 0;
+}
+
+int upload_ktex(const ktex_file* file, GLuint* tex) {
+	const ktex_header* h = file->header;
+	*tex = create_texture_2d(h->num_levels, h->gl_internal_format, h->width, h->height);
+	for (unsigned int i=0; i<h->num_levels; i++) {
+		upload_ktex_level(file, *tex, i);
+	}
+	texture_parameteri(*tex, GL_TEXTURE_BASE_LEVEL, 0);
+	texture_parameteri(*tex, GL_TEXTURE_MAX_LEVEL, h->num_levels - 1);
+	return 0;
+}
+
+/*
+ * Mip chain generation.
+ * Filtering happens in linear space: sRGB colour is decoded through a
+ * lookup table, each level is a 2x2 box filter of the previous (float)
+ * level, and only the stored copy is re-encoded to 8-bit sRGB.
+ */
+static float srgb_to_linear_lut[256];
+
+static void init_srgb_lut() {
+	for (int i=0; i<256; i++) {
+		float c = i / 255.0f;
+		srgb_to_linear_lut[i] = (c <= 0.04045f) ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+	}
+}
+
+static unsigned char linear_to_srgb8(float c) {
+	if (c <= 0.0f) { return 0; }
+	if (c >= 1.0f) { return 255; }
+	float s = (c <= 0.0031308f) ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+	return (unsigned char)(s * 255.0f + 0.5f);
+}
+
+static unsigned char linear_to_unorm8(float c) {
+	if (c <= 0.0f) { return 0; }
+	if (c >= 1.0f) { return 255; }
+	return (unsigned char)(c * 255.0f + 0.5f);
+}
+
+/*
+ * Run fn(first_row, last_row) over [0, rows) on all hardware threads.
+ * Small levels aren't worth the thread startup, so they run inline.
+ */
+template <typename F>
+static void parallel_rows(int rows, int row_width, F fn) {
+	int num_threads = std::thread::hardware_concurrency();
+	if (num_threads < 1) { num_threads = 1; }
+	if (rows * row_width < 64 * 64 || num_threads == 1) {
+		fn(0, rows);
+		return;
+	}
+	if (num_threads > rows) { num_threads = rows; }
+
+	std::vector<std::thread> workers;
+	int chunk = (rows + num_threads - 1) / num_threads;
+	for (int t=0; t<num_threads; t++) {
+		int first = t * chunk;
+		int last = (first + chunk < rows) ? first + chunk : rows;
+		if (first >= last) { break; }
+		workers.push_back(std::thread(fn, first, last));
+	}
+	for (unsigned int t=0; t<workers.size(); t++) {
+		workers[t].join();
+	}
+}
+
+// The source texels under each destination texel along one axis, and
+// their weights. Halving an even size is a plain 2-tap box; halving an
+// odd one (5 -> 2) means each texel covers 2.5 source texels, so it's
+// three taps with the shared middle texel split between neighbours,
+// and the last row or column isn't dropped.
+struct box_taps {
+	int first;
+	int count;
+	float w[3];
+};
+
+static void halving_taps(int src, int dst, std::vector<box_taps>* taps) {
+	taps->resize(dst);
+	for (int i=0; i<dst; i++) {
+		box_taps& t = (*taps)[i];
+		t.first = 2 * i;
+		if (src == 1) {
+			t.first = 0;
+			t.count = 1;
+			t.w[0] = 1.0f;
+		}
+		else if (src % 2 == 0) {
+			t.count = 2;
+			t.w[0] = t.w[1] = 0.5f;
+		}
+		else {
+			t.count = 3;
+			t.w[0] = (float)(dst - i) / src;
+			t.w[1] = (float)dst / src;
+			t.w[2] = (float)(i + 1) / src;
+		}
+	}
+}
+
+// Box filter of a linear RGBA float image down to half size.
+static void downsample_linear(const float* src, int sx, int sy,
+							  float* dst, int dx, int dy) {
+	std::vector<box_taps> x_taps, y_taps;
+	halving_taps(sx, dx, &x_taps);
+	halving_taps(sy, dy, &y_taps);
+	const box_taps* xt = &x_taps[0];
+	const box_taps* yt = &y_taps[0];
+	parallel_rows(dy, dx, [=](int first, int last) {
+		for (int y=first; y<last; y++) {
+			const box_taps& ty = yt[y];
+			float* out = dst + (y * dx * 4);
+			for (int x=0; x<dx; x++) {
+				const box_taps& tx = xt[x];
+#ifdef __SSE2__
+				// One RGBA pixel per SSE register.
+				__m128 sum = _mm_setzero_ps();
+				for (int j=0; j<ty.count; j++) {
+					const float* row = src + ((ty.first + j) * sx + tx.first) * 4;
+					__m128 row_sum = _mm_setzero_ps();
+					for (int i=0; i<tx.count; i++) {
+						row_sum = _mm_add_ps(row_sum, _mm_mul_ps(_mm_loadu_ps(row + i*4), _mm_set1_ps(tx.w[i])));
+					}
+					sum = _mm_add_ps(sum, _mm_mul_ps(row_sum, _mm_set1_ps(ty.w[j])));
+				}
+				_mm_storeu_ps(out + x*4, sum);
+#else
+				for (int c=0; c<4; c++) {
+					float sum = 0.0f;
+					for (int j=0; j<ty.count; j++) {
+						const float* row = src + ((ty.first + j) * sx + tx.first) * 4;
+						for (int i=0; i<tx.count; i++) {
+							sum += row[i*4+c] * tx.w[i] * ty.w[j];
+						}
+					}
+					out[x*4+c] = sum;
+				}
+#endif
+			}
+		}
+	});
+}
+
+/*
+ * Cook an RGBA8 sRGB image (already flipped to GL's bottom-up order)
+ * into a .ktex file with a full mip chain.
+ */
+int cook_texture(const unsigned char* rgba, int x, int y, const char* out_filename) {
+	init_srgb_lut();
+
+	ktex_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, KTEX_MAGIC, 8);
+	header.version = KTEX_VERSION;
+	header.flags = KTEX_FLAG_SRGB;
+	header.gl_internal_format = GL_SRGB8_ALPHA8;
+	header.gl_format = GL_RGBA;
+	header.gl_type = GL_UNSIGNED_BYTE;
+	header.width = x;
+	header.height = y;
+	header.channels = 4;
+
+	// Level layout.
+	int lx = x, ly = y;
+	uint64_t offset = (sizeof(ktex_header) + KTEX_ALIGN - 1) & ~(uint64_t)(KTEX_ALIGN - 1);
+	while (header.num_levels < KTEX_MAX_LEVELS) {
+		ktex_level* lvl = &header.levels[header.num_levels++];
+		lvl->width = lx;
+		lvl->height = ly;
+		lvl->offset = offset;
+		lvl->size = (uint64_t)lx * ly * 4;
+		offset = (offset + lvl->size + KTEX_ALIGN - 1) & ~(uint64_t)(KTEX_ALIGN - 1);
+		if (lx == 1 && ly == 1) { break; }
+		lx = (lx > 1) ? lx / 2 : 1;
+		ly = (ly > 1) ? ly / 2 : 1;
+	}
+
+	std::vector<unsigned char> out(offset, 0);
+	memcpy(&out[0], &header, sizeof(header));
+	memcpy(&out[header.levels[0].offset], rgba, header.levels[0].size);
+
+	// Decode the base level to linear floats.
+	std::vector<float> cur((size_t)x * y * 4);
+	float* cur_p = &cur[0];
+	parallel_rows(y, x, [=](int first, int last) {
+		for (int i=first*x*4; i<last*x*4; i+=4) {
+			cur_p[i]   = srgb_to_linear_lut[rgba[i]];
+			cur_p[i+1] = srgb_to_linear_lut[rgba[i+1]];
+			cur_p[i+2] = srgb_to_linear_lut[rgba[i+2]];
+			cur_p[i+3] = rgba[i+3] / 255.0f;
+		}
+	});
+
+	for (unsigned int l=1; l<header.num_levels; l++) {
+		const ktex_level* prev = &header.levels[l-1];
+		const ktex_level* lvl = &header.levels[l];
+		std::vector<float> next((size_t)lvl->width * lvl->height * 4);
+		downsample_linear(&cur[0], prev->width, prev->height,
+						  &next[0], lvl->width, lvl->height);
+
+		unsigned char* dst = &out[lvl->offset];
+		const float* src = &next[0];
+		int w = lvl->width;
+		parallel_rows(lvl->height, w, [=](int first, int last) {
+			for (int i=first*w*4; i<last*w*4; i+=4) {
+				dst[i]   = linear_to_srgb8(src[i]);
+				dst[i+1] = linear_to_srgb8(src[i+1]);
+				dst[i+2] = linear_to_srgb8(src[i+2]);
+				dst[i+3] = linear_to_unorm8(src[i+3]);
+			}
+		});
+		cur.swap(next);
+	}
+
+	FILE* file = fopen(out_filename, "wb");
+	if (!file) {
+		gl_log_error("ERROR: Could not open %s for writing\n", out_filename);
+		return 1;
+	}
+	size_t written = fwrite(&out[0], 1, out.size(), file);
+	fclose(file);
+	if (written != out.size()) {
+		gl_log_error("ERROR: Short write to %s\n", out_filename);
+		return 1;
+	}
+
+	gl_log("Cooked %s: %ix%i, %i levels, %lu bytes\n", out_filename,
+		   x, y, header.num_levels, (unsigned long)out.size());
+	return 0;
+}
+
+/*
+ * Texture loading.
+ */
+// textures/png/foo.png -> <dir>foo<ext>
+static void twin_path(const char* filename, const char* dir, const char* ext,
+					  char* out, int out_len) {
+	const char* base = strrchr(filename, '/');
+	base = base ? base + 1 : filename;
+	const char* dot = strrchr(base, '.');
+	int base_len = dot ? (int)(dot - base) : (int)strlen(base);
+	snprintf(out, out_len, "%s%.*s%s", dir, base_len, base, ext);
+}
+
+void cooked_texture_path(const char* filename, char* out, int out_len) {
+	twin_path(filename, KTEX_DIR, ".ktex", out, out_len);
+}
+
+void qoi_texture_path(const char* filename, char* out, int out_len) {
+	twin_path(filename, QOI_DIR, ".qoi", out, out_len);
+}
+
+bool twin_is_current(const char* filename, const char* twin_fn) {
+	struct stat twin, source;
+	if (stat(twin_fn, &twin) != 0) { return false; }
+	// No source to compare with (e.g. only the cooked files shipped).
+	if (stat(filename, &source) != 0) { return true; }
+	if (twin.st_mtim.tv_sec < source.st_mtim.tv_sec ||
+		(twin.st_mtim.tv_sec == source.st_mtim.tv_sec && twin.st_mtim.tv_nsec < source.st_mtim.tv_nsec)) {
+		gl_log("WARN:  %s is older than %s; using the source. Re-run make textures.\n", twin_fn, filename);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Decode an image to 'channels' channels, top row first.
+ * A QOI twin (textures/qoi/<name>.qoi) is much quicker to decode than
+ * PNG, so it's used whenever it exists and isn't older than the PNG.
+ */
+unsigned char* load_image(const char* filename, int* x, int* y, int channels) {
+	char qoi_fn[256];
+	qoi_texture_path(filename, qoi_fn, sizeof(qoi_fn));
+	if (twin_is_current(filename, qoi_fn)) {
+		unsigned char* data = qoi_read(qoi_fn, x, y, NULL, channels);
+		if (data) { return data; }
+	}
+
+	int n;
+	return stbi_load(filename, x, y, &n, channels);
+}
+
+// stb_image and the QOI decoder both allocate with malloc.
+void free_image(unsigned char* data) {
+	free(data);
+}
+
+int loadTexture(const char* filename, GLuint* tex) {
+	// Prefer the cooked version; it has its mips already.
+	char cooked_fn[256];
+	cooked_texture_path(filename, cooked_fn, sizeof(cooked_fn));
+	ktex_file cooked;
+	if (twin_is_current(filename, cooked_fn) && map_ktex(cooked_fn, &cooked) == 0) {
+		upload_ktex(&cooked, tex);
+		unmap_ktex(&cooked);
+		gl_bind_texture(GL_TEXTURE_2D, *tex);
+		return 0;
+	}
+
+	int tex_x, tex_y;
+	int tex_channels = 4;
+	unsigned char* tex_data = load_image(filename, &tex_x, &tex_y, tex_channels);
+	if (!tex_data) {
+		gl_log_error("ERROR: Could not load image: %s\n", filename);
+		// Still hand back a (blank) texture, like callers expect.
+		glGenTextures(1, tex);
+		gl_bind_texture(GL_TEXTURE_2D, *tex);
+		return 1;
+	}
+	if ((tex_x & (tex_x-1)) != 0 || (tex_y & (tex_y-1)) != 0) {
+		gl_log("WARN:  texture %s has x or y %% 2 != 0\n", filename);
+	}
+	// Flip the texture vertically.
+	flip_tex_V(tex_data, tex_x, tex_y, tex_channels);
+
+	int levels = 1;
+	while ((tex_x >> levels) || (tex_y >> levels)) { levels++; }
+	*tex = create_texture_2d(levels, GL_SRGB8_ALPHA8, tex_x, tex_y);
+	texture_sub_image_2d(*tex, 0, tex_x, tex_y, GL_RGBA, GL_UNSIGNED_BYTE, tex_data);
+	// Generate mipmaps.
+	generate_texture_mipmap(*tex);
+	free_image(tex_data);
+	gl_bind_texture(GL_TEXTURE_2D, *tex);
+	return 0;
+}
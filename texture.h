@@ -0,0 +1,80 @@
+#ifndef KESHI_TEXTURE
+#define KESHI_TEXTURE
+
+#include <GL/glew.h>
+
+#include <stdint.h>
+
+/*
+ * Cooked texture container ('.ktex').
+ * Roughly modeled on KTX2: a fixed header, a level index, then every
+ * mip level stored tightly packed, largest first. Level data starts on
+ * KTEX_ALIGN boundaries so a mapped file can be handed straight to GL.
+ * Pixel rows are stored bottom-to-top, so no flip is needed on load.
+ */
+#define KTEX_MAGIC "KESHITEX"
+#define KTEX_VERSION 1
+#define KTEX_MAX_LEVELS 16
+#define KTEX_ALIGN 16
+// Level data is block-compressed; upload with glCompressedTexImage2D.
+#define KTEX_FLAG_COMPRESSED 0x1
+// Colour channels are sRGB encoded, alpha is linear.
+#define KTEX_FLAG_SRGB 0x2
+
+struct ktex_level {
+	uint64_t offset;
+	uint64_t size;
+	uint32_t width;
+	uint32_t height;
+};
+
+struct ktex_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t flags;
+	// GL enums to upload with. gl_format/gl_type are 0 for compressed data.
+	uint32_t gl_internal_format;
+	uint32_t gl_format;
+	uint32_t gl_type;
+	uint32_t width;
+	uint32_t height;
+	uint32_t channels;
+	uint32_t num_levels;
+	uint32_t reserved;
+	ktex_level levels[KTEX_MAX_LEVELS];
+};
+
+// A read-only mapping of a .ktex file.
+struct ktex_file {
+	const ktex_header* header;
+	const unsigned char* data;
+	unsigned long size;
+};
+
+// Cooked texture files.
+int map_ktex(const char* filename, ktex_file* file);
+void unmap_ktex(ktex_file* file);
+// Creates '*tex' with immutable storage for every level and fills them.
+int upload_ktex(const ktex_file* file, GLuint* tex);
+int upload_ktex_level(const ktex_file* file, GLuint tex, int level);
+
+// Offline mip chain generation, used by the texcook tool.
+int cook_texture(const unsigned char* rgba, int x, int y, const char* out_filename);
+
+// Loads 'filename' into a new GL_TEXTURE_2D bound to the active unit.
+// A cooked '.ktex' twin (textures/ktex/<name>.ktex) is used if present
+// and current, otherwise the image is decoded and the mips generated by
+// the driver.
+int loadTexture(const char* filename, GLuint* tex);
+void cooked_texture_path(const char* filename, char* out, int out_len);
+void qoi_texture_path(const char* filename, char* out, int out_len);
+// Whether 'twin_fn' exists and is no older than the source 'filename'
+// (logs when it's stale), so an edited texture isn't shadowed by an old
+// cooked copy.
+bool twin_is_current(const char* filename, const char* twin_fn);
+
+// Image decoding; prefers a QOI twin in textures/qoi/ over the original.
+unsigned char* load_image(const char* filename, int* x, int* y, int channels);
+void free_image(unsigned char* data);
+
+#endif
@@ -0,0 +1,129 @@
+#include "uniformring.h"
+
+#include <algorithm>
+
+#include "glresource.h"
+#include "glstate.h"
+#include "util.h"
+
+static int align_up(int n, int alignment) {
+	return (n + alignment - 1) / alignment * alignment;
+}
+
+static void release_storage(uniform_ring* ring) {
+	for (unsigned int i=0; i<ring->fences.size(); i++) {
+		if (ring->fences[i]) { glDeleteSync(ring->fences[i]); }
+	}
+	ring->fences.clear();
+	// Deleting unmaps it too; GL keeps the storage until the GPU is done.
+	delete_buffer(&ring->buffer);
+	ring->mapped = NULL;
+}
+
+static void create_storage(uniform_ring* ring, int frames, int frame_size) {
+	release_storage(ring);
+	ring->frames = frames;
+	ring->frame_size = align_up(frame_size, ring->alignment);
+	ring->fences.assign(frames, (GLsync)0);
+	ring->frame = frames - 1;
+	ring->used = ring->flushed = 0;
+
+	GLsizeiptr total = (GLsizeiptr)frames * ring->frame_size;
+	if (ring->persistent) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		ring->buffer = create_buffer(total, NULL, flags);
+		ring->mapped = (char*)map_buffer_range(ring->buffer, 0, total, flags);
+	}
+	else {
+		ring->buffer = create_mutable_buffer(total, NULL, GL_DYNAMIC_DRAW);
+		ring->staging.resize(ring->frame_size);
+	}
+}
+
+int init_uniform_ring(uniform_ring* ring, int frame_size) {
+	ring->buffer = 0;
+	ring->mapped = NULL;
+	ring->persistent = gl_caps.buffer_storage;
+	GLint ubo_align = 0, ssbo_align = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &ubo_align);
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &ssbo_align);
+	ring->alignment = std::max(std::max(ubo_align, ssbo_align), 16);
+	ring->overflowed = false;
+	ring->grows = 0;
+	ring->failed_allocs = 0;
+
+	create_storage(ring, UNIFORM_RING_FRAMES, frame_size);
+	if (ring->persistent && !ring->mapped) {
+		gl_log_error("ERROR: Could not map the uniform ring\n");
+		return 1;
+	}
+	gl_log("Uniform ring: %i x %i bytes, %i byte alignment, %s\n", ring->frames,
+		   ring->frame_size, ring->alignment,
+		   ring->persistent ? "persistent mapped" : "staged with glBufferSubData");
+	return 0;
+}
+
+void destroy_uniform_ring(uniform_ring* ring) {
+	release_storage(ring);
+	ring->staging.clear();
+}
+
+void begin_uniform_ring_frame(uniform_ring* ring) {
+	int next = (ring->frame + 1) % ring->frames;
+	bool busy = false;
+	if (ring->fences[next]) {
+		// A zero timeout only polls.
+		busy = glClientWaitSync(ring->fences[next], 0, 0) == GL_TIMEOUT_EXPIRED;
+		if (!busy) {
+			glDeleteSync(ring->fences[next]);
+			ring->fences[next] = 0;
+		}
+	}
+
+	if (busy || ring->overflowed) {
+		int frames = ring->frames + (busy ? 1 : 0);
+		int frame_size = ring->overflowed ? ring->frame_size * 2 : ring->frame_size;
+		gl_log("Uniform ring %s; growing to %i x %i bytes\n",
+			   busy ? "caught up with the GPU" : "ran out of room", frames, frame_size);
+		create_storage(ring, frames, frame_size);
+		ring->overflowed = false;
+		ring->grows++;
+		next = 0;
+	}
+	ring->frame = next;
+	ring->used = ring->flushed = 0;
+}
+
+uniform_alloc alloc_uniforms(uniform_ring* ring, int size) {
+	uniform_alloc a = { NULL, 0, size };
+	int start = align_up(ring->used, ring->alignment);
+	if (start + size > ring->frame_size) {
+		if (!ring->overflowed) {
+			gl_log_error("ERROR: Uniform ring out of room for %i bytes this frame\n", size);
+		}
+		ring->overflowed = true;
+		ring->failed_allocs++;
+		return a;
+	}
+	ring->used = start + size;
+	a.offset = (GLintptr)ring->frame * ring->frame_size + start;
+	a.ptr = ring->persistent ? ring->mapped + a.offset : &ring->staging[start];
+	return a;
+}
+
+void flush_uniform_ring(uniform_ring* ring) {
+	if (ring->persistent || ring->used == ring->flushed) { return; }
+	set_buffer_sub_data(ring->buffer, (GLintptr)ring->frame * ring->frame_size + ring->flushed,
+						ring->used - ring->flushed, &ring->staging[ring->flushed]);
+	ring->flushed = ring->used;
+}
+
+void bind_uniforms(const uniform_ring* ring, GLenum target, GLuint binding, uniform_alloc alloc) {
+	if (!alloc.ptr) { return; }
+	gl_bind_buffer_range(target, binding, ring->buffer, alloc.offset, alloc.size);
+}
+
+void end_uniform_ring_frame(uniform_ring* ring) {
+	if (ring->fences[ring->frame]) { glDeleteSync(ring->fences[ring->frame]); }
+	ring->fences[ring->frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
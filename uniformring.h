@@ -0,0 +1,66 @@
+#ifndef KESHI_UNIFORMRING
+#define KESHI_UNIFORMRING
+
+#include <GL/glew.h>
+
+#include <vector>
+
+// Regions to start with; one per frame the GPU may be behind, plus the
+// one being written.
+#define UNIFORM_RING_FRAMES 3
+// Starting size of each region, in bytes.
+#define UNIFORM_RING_FRAME_SIZE (256 * 1024)
+
+/*
+ * Per-frame uniform (and shader storage) data.
+ * One buffer, split into a region per frame in flight. Each frame
+ * alloc_uniforms() hands out aligned pieces of the current region to
+ * write into and bind_uniforms() binds them with glBindBufferRange;
+ * end_uniform_ring_frame() fences the region so it isn't reused while
+ * the GPU may still read it.
+ * With ARB_buffer_storage the buffer is mapped once, persistent and
+ * coherent, so writes go straight into GPU visible memory. Without it
+ * allocations are staged on the CPU and flush_uniform_ring() sends them
+ * with one glBufferSubData.
+ * The CPU never waits on a fence: if the next region is still busy, or
+ * a frame ran out of room, the ring grows at the next frame instead
+ * (the old buffer lives on until the GPU is done with it).
+ */
+struct uniform_ring {
+	GLuint buffer;
+	bool persistent;
+	char* mapped;
+	std::vector<char> staging;
+	int frames;
+	int frame_size;
+	// Max of the UBO and SSBO offset alignments.
+	int alignment;
+	int frame;
+	int used;
+	// Where this frame's unflushed writes start (staging path).
+	int flushed;
+	std::vector<GLsync> fences;
+	bool overflowed;
+	unsigned long grows;
+	unsigned long failed_allocs;
+};
+
+struct uniform_alloc {
+	// NULL if the frame was out of room.
+	void* ptr;
+	GLintptr offset;
+	GLsizeiptr size;
+};
+
+int init_uniform_ring(uniform_ring* ring, int frame_size);
+void destroy_uniform_ring(uniform_ring* ring);
+// Moves to the next region; call before any alloc_uniforms() in a frame.
+void begin_uniform_ring_frame(uniform_ring* ring);
+uniform_alloc alloc_uniforms(uniform_ring* ring, int size);
+// Before drawing with this frame's allocations; free when persistent.
+void flush_uniform_ring(uniform_ring* ring);
+void bind_uniforms(const uniform_ring* ring, GLenum target, GLuint binding, uniform_alloc alloc);
+// After the frame's last draw.
+void end_uniform_ring_frame(uniform_ring* ring);
+
+#endif
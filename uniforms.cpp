@@ -0,0 +1,95 @@
+#include "uniforms.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "util.h"
+
+// std140: mat4 and vec4 are 16-byte aligned.
+static_assert(sizeof(m4) == 64 && sizeof(v4) == 16, "math3d types must be tightly packed");
+static_assert(offsetof(camera_block, P) == 64, "camera_block must match cam_ubo in camera.glsl");
+
+/*
+ * Reflection.
+ * Compares each mirror member's offset with GL_UNIFORM_OFFSET, so a
+ * shader edit that moves something shows up in the log instead of as
+ * garbage on screen.
+ */
+static int check_layout(GLuint program, const char* block_name,
+						const std::vector<uniform_field>& fields) {
+	std::vector<const char*> names;
+	for (unsigned int i=0; i<fields.size(); i++) {
+		names.push_back(fields[i].name.c_str());
+	}
+	std::vector<GLuint> indices(fields.size());
+	std::vector<GLint> offsets(fields.size());
+	glGetUniformIndices(program, names.size(), &names[0], &indices[0]);
+
+	int mismatched = 0;
+	for (unsigned int i=0; i<fields.size(); i++) {
+		// Unused members can be optimised out; nothing to check there.
+		if (indices[i] == GL_INVALID_INDEX) { continue; }
+		glGetActiveUniformsiv(program, 1, &indices[i], GL_UNIFORM_OFFSET, &offsets[i]);
+		if (offsets[i] != fields[i].offset) {
+			gl_log_error("ERROR: %s.%s is at offset %i in the shader but %i on the CPU\n",
+						 block_name, names[i], offsets[i], fields[i].offset);
+			mismatched++;
+		}
+	}
+	return mismatched;
+}
+
+void init_uniform_block(uniform_block* block, const char* name, GLuint binding,
+						const void* data, int capacity) {
+	block->name = name;
+	block->binding = binding;
+	block->data = data;
+	block->size = capacity;
+	block->current.ptr = NULL;
+	block->uploads = 0;
+}
+
+int reflect_uniform_block(uniform_block* block, GLuint program,
+						  const std::vector<uniform_field>& fields) {
+	const char* name = block->name.c_str();
+	GLuint index = glGetUniformBlockIndex(program, name);
+	if (index == GL_INVALID_INDEX) {
+		gl_log("WARN:  %s isn't used by program %i; can't check its layout\n", name, program);
+		return 0;
+	}
+	int failed = 0;
+	GLint size = 0;
+	glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+	if (size > block->size) {
+		gl_log_error("ERROR: %s is %i bytes but its mirror only has %i\n", name, size, block->size);
+		failed++;
+	}
+	else {
+		block->size = size;
+	}
+	failed += check_layout(program, name, fields);
+	return failed ? 1 : 0;
+}
+
+void upload_uniform_block(uniform_block* block, uniform_ring* ring) {
+	block->current = alloc_uniforms(ring, block->size);
+	if (!block->current.ptr) { return; }
+	memcpy(block->current.ptr, block->data, block->size);
+	bind_uniforms(ring, GL_UNIFORM_BUFFER, block->binding, block->current);
+	block->uploads++;
+}
+
+/*
+ * Mirror descriptions, for the reflection check.
+ */
+static void add_field(std::vector<uniform_field>* fields, const std::string& name, int offset) {
+	uniform_field f = { name, offset };
+	fields->push_back(f);
+}
+
+std::vector<uniform_field> camera_block_fields() {
+	std::vector<uniform_field> fields;
+	add_field(&fields, "V", offsetof(camera_block, V));
+	add_field(&fields, "P", offsetof(camera_block, P));
+	return fields;
+}
@@ -0,0 +1,57 @@
+#ifndef KESHI_UNIFORMS
+#define KESHI_UNIFORMS
+
+#include <GL/glew.h>
+
+#include <string>
+#include <vector>
+
+#include "math3d.h"
+#include "uniformring.h"
+
+/*
+ * CPU mirror of the std140 camera block in shaders/include/, member for member.
+ * Matrices are stored column-major (i.e. transposed m4s), like GLSL wants.
+ * uniforms.cpp checks the layout at compile time, and reflect_uniform_block
+ * checks it again against a linked program.
+ */
+struct camera_block {
+	m4 V;
+	m4 P;
+};
+
+// A block member's name in GLSL and its offset in the mirror struct.
+struct uniform_field {
+	std::string name;
+	int offset;
+};
+
+/*
+ * A uniform block fed from a CPU mirror.
+ * upload_uniform_block() copies the whole mirror into this frame's
+ * region of a uniform_ring and binds it there, one memcpy instead of
+ * one call per member. Regions rotate, so it's every frame, changed
+ * or not.
+ */
+struct uniform_block {
+	std::string name;
+	GLuint binding;
+	const void* data;
+	// Bytes GL says the block takes; what each upload writes.
+	int size;
+	uniform_alloc current;
+	unsigned long uploads;
+};
+
+void init_uniform_block(uniform_block* block, const char* name, GLuint binding,
+						const void* data, int capacity);
+// Checks the mirror against 'program' and trims uploads to the real
+// block size. Returns nonzero on a mismatch.
+int reflect_uniform_block(uniform_block* block, GLuint program,
+						  const std::vector<uniform_field>& fields);
+// Once per frame, before drawing (and before flush_uniform_ring).
+void upload_uniform_block(uniform_block* block, uniform_ring* ring);
+
+std::vector<uniform_field> camera_block_fields();
+
+#endif
@@ -1,53 +1,10 @@
 #include "util.h"
 
-unsigned long getFileLength(std::ifstream& file) {
-	if (!file.good()) return 0;
+#include "batch.h"
 
-	unsigned long len = file.tellg();
-	file.seekg(0, std::ios::end);
-	len = file.tellg();
-	file.seekg(std::ios::beg);
+gl_capabilities gl_caps;
 
-	return len;
-}
-
-int loadShader(const char* filename, GLuint shader) {
-	std::ifstream file;
-	file.open(filename, std::ios::in);
-	if (!file) return 1;
-
-	unsigned long len = getFileLength(file);
-	char* contents = new char[len+1];
-	const char* c_constants;
-	file.read(contents, len);
-	contents[len] = '\0';
-	c_constants = contents;
-
-	glShaderSource(shader, 1, &c_constants, NULL);
-	glCompileShader(shader);
-
-	// Log any shader compilation errors.
-	int params = -1;
-	glGetShaderiv(shader, GL_COMPILE_STATUS, &params);
-	if (GL_TRUE != params) {
-		gl_log_error("ERROR: GL shader '%s'(%i) did not compile\n", filename, shader);
-		int actual_length = 0;
-		char log[GL_SHADER_LOG_LEN];
-		glGetShaderInfoLog(shader, GL_SHADER_LOG_LEN, &actual_length, log);
-		gl_log("Shader info log for '%s'(%i):\n---\n%s\n---\n", filename, shader, log);
-	}
-
-	file.close();
-	delete contents;
-
-	return 0;
-}
-
-int loadMesh(const char* filename, GLuint* vao, int* num_vertices) {
-	return loadMesh(filename, vao, num_vertices, false);
-}
-
-int loadMesh(const char* filename, GLuint* vao, int* num_vertices, bool mesh_debug) {
+int loadMesh(const char* filename, static_batch* batch, int* object) {
 	const aiScene* scene = aiImportFile(filename, aiProcess_Triangulate);
 
 	if (!scene) {
@@ -55,108 +12,69 @@ int loadMesh(const char* filename, GLuint* vao, int* num_vertices, bool mesh_deb
 		return 1;
 	}
 
-	if (mesh_debug) {
-		// Log some information about the mesh.
-		gl_log("Loaded mesh %s\n", filename);
-		gl_log("  %i animations\n", scene->mNumAnimations);
-		gl_log("  %i cameras\n",    scene->mNumCameras);
-		gl_log("  %i lights\n",     scene->mNumLights);
-		gl_log("  %i materials\n",  scene->mNumMaterials);
-		gl_log("  %i meshes\n",     scene->mNumMeshes);
-		gl_log("  %i textures\n",   scene->mNumTextures);
-		gl_log("----------------------\n");
-	}
+	// Some information about the mesh; -log mesh=debug to see it.
+	log_debug(LOG_MESH, "Loaded mesh %s\n", filename);
+	log_debug(LOG_MESH, "  %i animations\n", scene->mNumAnimations);
+	log_debug(LOG_MESH, "  %i cameras\n",    scene->mNumCameras);
+	log_debug(LOG_MESH, "  %i lights\n",     scene->mNumLights);
+	log_debug(LOG_MESH, "  %i materials\n",  scene->mNumMaterials);
+	log_debug(LOG_MESH, "  %i meshes\n",     scene->mNumMeshes);
+	log_debug(LOG_MESH, "  %i textures\n",   scene->mNumTextures);
+	log_debug(LOG_MESH, "----------------------\n");
 
 	// For now, just get the first mesh.
 	const aiMesh* mesh = scene->mMeshes[0];
 
-	if (mesh_debug) {
-		gl_log("  Mesh 0:\n");
-		gl_log("    %i  vertices\n", mesh->mNumVertices);
-	}
+	log_debug(LOG_MESH, "  Mesh 0:\n");
+	log_debug(LOG_MESH, "    %i  vertices\n", mesh->mNumVertices);
 
 	// Populate # of vertices in the mesh.
-	*num_vertices = mesh->mNumVertices;
+	int num_vertices = mesh->mNumVertices;
 
-	// Create the VAO.
-	glGenVertexArrays(1, vao);
-	glBindVertexArray(*vao);
-	
 	GLfloat* points = NULL;
 	GLfloat* normals = NULL;
 	GLfloat* texcoords = NULL;
 
 	// Fill up position vectors.
 	if (mesh->HasPositions()) {
-		points = new GLfloat [*num_vertices * 3];
-		for (int i=0; i<*num_vertices; i++) {
+		points = new GLfloat [num_vertices * 3];
+		for (int i=0; i<num_vertices; i++) {
 			const aiVector3D* vec_pos = &(mesh->mVertices[i]);
 			points[i*3] = (GLfloat) vec_pos->x;
 			points[(i*3)+1] = (GLfloat) vec_pos->y;
 			points[(i*3)+2] = (GLfloat) vec_pos->z;
 		}
 	}
+	else { log_warn(LOG_MESH, "Warning: Loaded mesh %s with no position vertices.\n", filename); }
 
 	// Mesh's normal vectors.
 	if (mesh->HasNormals()) {
-		normals = new GLfloat [*num_vertices * 3];
-		for (int i=0; i<*num_vertices; i++) {
+		normals = new GLfloat [num_vertices * 3];
+		for (int i=0; i<num_vertices; i++) {
 			const aiVector3D* vec_norm = &(mesh->mNormals[i]);
 			normals[i*3] = (GLfloat) vec_norm->x;
 			normals[(i*3)+1] = (GLfloat) vec_norm->y;
 			normals[(i*3)+2] = (GLfloat) vec_norm->z;
 		}
 	}
+	else { log_warn(LOG_MESH, "Warning: Loaded mesh %s with no normals.\n", filename); }
 
 	// Texture coordinates, if applicable.
 	if (mesh->HasTextureCoords(0)) {
-		texcoords = new GLfloat [*num_vertices * 2];
-		for (int i=0; i<*num_vertices; i++) {
+		texcoords = new GLfloat [num_vertices * 2];
+		for (int i=0; i<num_vertices; i++) {
 			const aiVector3D* vec_tex = &(mesh->mTextureCoords[0][i]);
 			texcoords[i*2] = (GLfloat) vec_tex->x;
 			texcoords[(i*2)+1] = (GLfloat) vec_tex->y;
 		}
 	}
+	else { log_warn(LOG_MESH, "Warning: Loaded mesh %s with no texture coordinates.\n", filename); }
 
-	// Copy mesh data into VBOs.
-	if (mesh->HasPositions()) {
-		GLuint points_vbo;
-		glGenBuffers(1, &points_vbo);
-		glBindBuffer(GL_ARRAY_BUFFER, points_vbo);
-		glBufferData(GL_ARRAY_BUFFER, (3 * *num_vertices * sizeof(GLfloat)),
-					 points, GL_STATIC_DRAW);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-		glEnableVertexAttribArray(0);
-
-		delete points;
-	}
-	else { gl_log("Warning: Loaded mesh %s with no position vertices.\n", filename); }
-
-	if (mesh->HasNormals()) {
-		GLuint normals_vbo;
-		glGenBuffers(1, &normals_vbo);
-		glBindBuffer(GL_ARRAY_BUFFER, normals_vbo);
-		glBufferData(GL_ARRAY_BUFFER, (3 * *num_vertices * sizeof(GLfloat)),
-					 normals, GL_STATIC_DRAW);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-		glEnableVertexAttribArray(1);
-
-		delete normals;
-	}
-	else { gl_log("Warning: Loaded mesh %s with no normals.\n", filename); }
-
-	if (mesh->HasTextureCoords(0)) {
-		GLuint texcoords_vbo;
-		glGenBuffers(1, &texcoords_vbo);
-		glBindBuffer(GL_ARRAY_BUFFER, texcoords_vbo);
-		glBufferData(GL_ARRAY_BUFFER, (2 * *num_vertices * sizeof(GLfloat)),
-					 texcoords, GL_STATIC_DRAW);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, NULL);
-		glEnableVertexAttribArray(2);
-
-		delete texcoords;
-	}
-	else { gl_log("Warning: Loaded mesh %s with no texture coordinates.\n", filename); }
+	// Interleaved into the batch; it goes up with build_static_batch().
+	*object = add_static_mesh(batch, points, normals, texcoords, num_vertices);
+	delete[] points;
+	delete[] normals;
+	delete[] texcoords;
 
 	// Free assimp buffer.
 	aiReleaseImport(scene);
@@ -167,56 +85,6 @@ int loadMesh(const char* filename, GLuint* vao, int* num_vertices, bool mesh_deb
 /*
  * OpenGL logging functions.
  */
-int restart_gl_log() {
-	FILE* file = fopen(GL_LOG_FILE, "a");
-	if (!file) {
-		fprintf(stderr, "Error: couldn't open log file for writing: %s\n", GL_LOG_FILE);
-		return 1;
-	}
-
-	time_t now = time(NULL);
-	char* datetime = ctime(&now);
-	fprintf(file, "----------\nInit log. Local time %s\n", datetime);
-
-	fclose(file);
-	return 0;
-}
-
-int gl_log(const char* msg, ...) {
-	va_list argptr;
-	FILE* file = fopen(GL_LOG_FILE, "a");
-	if (!file) {
-		fprintf(stderr, "Error: couldn't open log file for appending: %s\n", GL_LOG_FILE);
-		return 1;
-	}
-
-	va_start(argptr, msg);
-	vfprintf(file, msg, argptr);
-	va_end(argptr);
-	
-	fclose(file);
-	return 0;
-}
-
-int gl_log_error(const char* msg, ...) {
-	va_list argptr;
-	FILE* file = fopen(GL_LOG_FILE, "a");
-	if (!file) {
-		fprintf(stderr, "Error: couldn't open log file for appending: %s\n", GL_LOG_FILE);
-		return 1;
-	}
-
-	va_start(argptr, msg);
-	vfprintf(file, msg, argptr);
-	va_end(argptr);
-	va_start(argptr, msg);
-	vfprintf(stderr, msg, argptr);
-	va_end(argptr);
-	
-	fclose(file);
-	return 0;
-}
-
 void gl_info() {
 	int num_int_params = 14;
 	GLenum params[] = {
@@ -272,24 +140,38 @@ void gl_info() {
 	gl_log("-----------------------------\n");
 }
 
-void gl_ext_check(int *err_param) {
+void gl_ext_check() {
 	gl_log("GL Extensions check:\n");
 
 	// KHR Debugging.
-	if (GLEW_KHR_debug) {
-		gl_log("KHR debugging extension found.\n");
-		glDebugMessageCallback(gl_error_debug, err_param);
-		glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
-		gl_log("Set up debugging callback.");
-	}
-	else {
-		gl_log("KHR debug extension not found...\n");
+	gl_caps.khr_debug = GLEW_KHR_debug;
+	gl_log("KHR debug extension %s.\n", gl_caps.khr_debug ? "found" : "not found");
+
+	// Shader storage buffers (core in 4.3).
+	gl_caps.shader_storage = GLEW_VERSION_4_3 || GLEW_ARB_shader_storage_buffer_object;
+	gl_log("Shader storage buffers %s.\n", gl_caps.shader_storage ? "found" : "not found");
+
+	// Bindless textures.
+	gl_caps.bindless_texture = GLEW_ARB_bindless_texture && gl_caps.shader_storage;
+	gl_log("ARB bindless texture extension %s.\n", gl_caps.bindless_texture ? "found" : "not found");
+
+	// Background shader compiles; let the driver pick the thread count.
+	gl_caps.parallel_shader_compile = GLEW_KHR_parallel_shader_compile;
+	if (GLEW_KHR_parallel_shader_compile) {
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
 	}
-}
+	gl_log("KHR parallel shader compile extension %s.\n",
+		   gl_caps.parallel_shader_compile ? "found" : "not found");
+
+	// Persistent mapped buffers (core in 4.4).
+	gl_caps.buffer_storage = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+	gl_log("Buffer storage %s.\n", gl_caps.buffer_storage ? "found" : "not found");
+
+	// Draw commands from a buffer (core in 4.3).
+	gl_caps.multi_draw_indirect = GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect;
+	gl_log("Multi draw indirect %s.\n", gl_caps.multi_draw_indirect ? "found" : "not found");
 
-void gl_error_debug(unsigned int source, unsigned int type,
-					unsigned int id, unsigned int severity,
-					int length, const char* message,
-					void* user_param) {
-	gl_log_error("OpenGL error: %s", message);
+	// Editing objects by name (core in 4.5).
+	gl_caps.direct_state_access = GLEW_VERSION_4_5 || GLEW_ARB_direct_state_access;
+	gl_log("Direct state access %s.\n", gl_caps.direct_state_access ? "found" : "not found");
 }
@@ -6,29 +6,38 @@
 #include <fstream>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <string>
 #include <time.h>
 
 #include <assimp/cimport.h>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
-#define GL_LOG_FILE "log/gl.log"
+#include "logger.h"
+
+struct static_batch;
+
 #define GL_SHADER_LOG_LEN 2048
 
-unsigned long getFileLength(std::ifstream& file);
-int loadShader(const char* filename, GLuint shader);
-int loadMesh(const char* filename, GLuint* vao, int* num_vertices);
-int loadMesh(const char* filename, GLuint* vao, int* num_vertices, bool mesh_debug);
+// What the context supports; filled in by gl_ext_check().
+struct gl_capabilities {
+	bool khr_debug;
+	bool bindless_texture;
+	bool shader_storage;
+	bool parallel_shader_compile;
+	bool buffer_storage;
+	bool multi_draw_indirect;
+	// See glresource.h.
+	bool direct_state_access;
+};
+extern gl_capabilities gl_caps;
+
+// Adds the file's first mesh to a static batch as one object.
+int loadMesh(const char* filename, static_batch* batch, int* object);
 
-// OpenGL logging stuff.
-int restart_gl_log();
-int gl_log(const char* msg, ...);
-int gl_log_error(const char* msg, ...);
+// OpenGL logging stuff (gl_log itself is in logger.h).
 void gl_info();
-void gl_ext_check(int *err_param);
-void gl_error_debug(unsigned int source, unsigned int type,
-					unsigned int id, unsigned int severity,
-					int length, const char* message,
-					void* user_param);
+// Fills in gl_caps. Debug output is set up by init_gl_debug() (gldebug.h).
+void gl_ext_check();
 
 #endif